@@ -0,0 +1,118 @@
+/******************************************************************************
+*       bitpack_test.c
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains a differential test of um_bitpack.h: it runs the
+*       inline um_getu, um_newu and um_fitsu and the Bitpack functions from
+*       bitpack_copy.c on the same arguments (every width and lsb, on edge
+*       case and pseudo-random words and values) and reports any result
+*       that differs. Built and run by make test-bitpack.
+*
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "bitpack.h"
+#include "um_bitpack.h"
+
+#define RANDOM_WORDS 200
+#define MAX_REPORTS 10
+
+static const uint64_t edge_words[] = {
+        0, ~(uint64_t)0, 0xfeedfacedeadbeef, (uint64_t)1 << 63, 1,
+        0x00000000ffffffff, 0xdeadbeef
+};
+
+#define NUM_EDGE_WORDS (sizeof(edge_words) / sizeof(edge_words[0]))
+
+static uint64_t checks = 0;
+static uint64_t mismatches = 0;
+
+/*
+*       Description: A small xorshift generator, so every run tests the
+*       same words.
+*/
+static uint64_t next_random(uint64_t *state)
+{
+        *state ^= *state << 13;
+        *state ^= *state >> 7;
+        *state ^= *state << 17;
+        return *state;
+}
+
+/*
+*       Description: Counts one comparison, and reports it if the two
+*       results differ.
+*
+*       In/Out Expectations: Expects the function's name, its arguments
+*       (value is 0 where unused), and both results. Returns nothing.
+*/
+static void check(const char *name, uint64_t word, unsigned width,
+                  unsigned lsb, uint64_t value, uint64_t got,
+                  uint64_t expected)
+{
+        checks++;
+        if (got == expected) {
+                return;
+        }
+        if (mismatches++ < MAX_REPORTS) {
+                fprintf(stderr, "%s(0x%016" PRIx64 ", %u, %u, 0x%" PRIx64
+                        ") is 0x%016" PRIx64 ", Bitpack gives 0x%016"
+                        PRIx64 "\n", name, word, width, lsb, value, got,
+                        expected);
+        }
+}
+
+/*
+*       Description: Checks every field of a word, and replaces each with
+*       0, its largest value, and a pseudo-random value that fits.
+*
+*       In/Out Expectations: Expects a word and the generator's state.
+*       Returns nothing.
+*/
+static void check_word(uint64_t word, uint64_t *state)
+{
+        for (unsigned width = 0; width <= 64; width++) {
+                uint64_t mask = width == 64 ? ~(uint64_t)0 :
+                                ((uint64_t)1 << width) - 1;
+                uint64_t values[] = { 0, mask, next_random(state) & mask };
+                for (unsigned lsb = 0; lsb + width <= 64; lsb++) {
+                        check("um_getu", word, width, lsb, 0,
+                              um_getu(word, width, lsb),
+                              Bitpack_getu(word, width, lsb));
+                        for (int i = 0; i < 3; i++) {
+                                check("um_newu", word, width, lsb, values[i],
+                                      um_newu(word, width, lsb, values[i]),
+                                      Bitpack_newu(word, width, lsb,
+                                                   values[i]));
+                        }
+                }
+                check("um_fitsu", word, width, 0, 0, um_fitsu(word, width),
+                      Bitpack_fitsu(word, width));
+        }
+}
+
+/*
+*       Description: Runs every check and prints a summary.
+*
+*       In/Out Expectations: Expects no arguments. Returns exit failure if
+*       any result differed.
+*/
+int main(void)
+{
+        uint64_t state = 0x2545f4914f6cdd1d;
+        for (size_t i = 0; i < NUM_EDGE_WORDS; i++) {
+                check_word(edge_words[i], &state);
+        }
+        for (int i = 0; i < RANDOM_WORDS; i++) {
+                check_word(next_random(&state), &state);
+        }
+
+        printf("bitpack_test: %" PRIu64 " checks, %" PRIu64
+               " mismatches\n", checks, mismatches);
+        return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,431 @@
+/******************************************************************************
+*       memory_bench.c
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains microbenchmarks for memory_type. Each workload
+*       drives the memory API directly (new_seg, free_segment, get_memory,
+*       set_word, duplicate_instructions) in a pattern um programs use, so
+*       a change to the segment store can be measured without running a
+*       whole program. It prints one JSON object per workload with the
+*       median time per operation and the heap allocations per operation.
+*       Allocations are counted by replacing malloc, calloc and realloc
+*       with versions that count calls, which works with glibc.
+*
+*       Usage: memory_bench [-n runs] [workload ...]
+*
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+#include "memory_type.h"
+
+#define DEFAULT_RUNS 5
+#define MAX_RUNS 100
+
+#define TINY_SEGMENTS 200000
+#define HUGE_WORDS (1u << 20)
+#define HUGE_ROUNDS 16
+#define HUGE_SEGMENTS 4
+#define LIVE_SEGMENTS 4096
+#define CHURN_OPS 500000
+#define SMALL_WORDS 64
+#define PASSES 16
+#define RANDOM_OPS 4000000
+#define LOADP_OPS 100000
+#define LOADP_COPIES 50
+
+/* Counted by the wrappers; read at the start and end of each timing */
+static uint64_t allocations = 0;
+static volatile uint32_t sink;
+
+/*
+*       Description: Counting replacements for the allocator functions
+*       memory_type uses, which pass the call on to glibc's own (glibc
+*       allows a program to replace them this way; free is glibc's).
+*/
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *p, size_t size);
+
+void *malloc(size_t size)
+{
+        allocations++;
+        return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+        allocations++;
+        return __libc_calloc(count, size);
+}
+
+void *realloc(void *p, size_t size)
+{
+        allocations++;
+        return __libc_realloc(p, size);
+}
+
+/*
+*       Description: The timed part of one run of a workload: when it
+*       started, and the allocation count then; then its length and the
+*       allocations it made.
+*/
+struct timing {
+        struct timespec start;
+        uint64_t start_allocations;
+        double seconds;
+        uint64_t allocations;
+};
+
+static void begin(struct timing *t)
+{
+        t->start_allocations = allocations;
+        clock_gettime(CLOCK_MONOTONIC, &t->start);
+}
+
+static void end(struct timing *t)
+{
+        struct timespec stop;
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        t->allocations = allocations - t->start_allocations;
+        t->seconds = (stop.tv_sec - t->start.tv_sec) +
+                     (stop.tv_nsec - t->start.tv_nsec) / 1e9;
+}
+
+/*
+*       Description: A small xorshift generator, so every run makes the
+*       same choices.
+*/
+static inline uint32_t next_random(uint64_t *state)
+{
+        *state ^= *state << 13;
+        *state ^= *state >> 7;
+        *state ^= *state << 17;
+        return *state >> 32;
+}
+
+/*
+*       Description: Makes a memory with a one word segment 0, as a loaded
+*       program would have, so the workload's segments get ids from 1.
+*/
+static memory new_bench_memory(void)
+{
+        memory mem = new_memory();
+        new_seg(mem, 1);
+        return mem;
+}
+
+/*
+*       Description: Maps many segments of 1 to 8 words, then unmaps them
+*       all.
+*
+*       In/Out Expectations: Each workload expects a timing to fill in for
+*       its measured part and returns the number of operations in it.
+*/
+static uint64_t tiny_map_unmap(struct timing *t)
+{
+        memory mem = new_bench_memory();
+        uint32_t *ids = malloc(TINY_SEGMENTS * sizeof(*ids));
+        begin(t);
+        for (uint32_t i = 0; i < TINY_SEGMENTS; i++) {
+                ids[i] = new_seg(mem, 1 + i % 8);
+        }
+        for (uint32_t i = 0; i < TINY_SEGMENTS; i++) {
+                free_segment(mem, ids[i]);
+        }
+        end(t);
+        free(ids);
+        free_memory(mem);
+        return 2 * (uint64_t)TINY_SEGMENTS;
+}
+
+/*
+*       Description: Maps a few 4MB segments, writes a word every page,
+*       and unmaps them, a number of times.
+*/
+static uint64_t huge_map_unmap(struct timing *t)
+{
+        memory mem = new_bench_memory();
+        uint32_t ids[HUGE_SEGMENTS];
+        begin(t);
+        for (int round = 0; round < HUGE_ROUNDS; round++) {
+                for (int i = 0; i < HUGE_SEGMENTS; i++) {
+                        ids[i] = new_seg(mem, HUGE_WORDS);
+                        for (uint32_t w = 0; w < HUGE_WORDS; w += 1024) {
+                                set_word(mem, ids[i], w, w);
+                        }
+                }
+                for (int i = 0; i < HUGE_SEGMENTS; i++) {
+                        free_segment(mem, ids[i]);
+                }
+        }
+        end(t);
+        free_memory(mem);
+        return 2 * (uint64_t)HUGE_ROUNDS * HUGE_SEGMENTS;
+}
+
+/*
+*       Description: Keeps LIVE_SEGMENTS segments mapped and replaces a
+*       random one at a time with a new segment of 1 to 128 words, so ids
+*       are reused and both slab blocks and malloc are used.
+*/
+static uint64_t churn_reuse(struct timing *t)
+{
+        memory mem = new_bench_memory();
+        uint32_t ids[LIVE_SEGMENTS];
+        uint64_t state = 0x2545f4914f6cdd1d;
+        for (int i = 0; i < LIVE_SEGMENTS; i++) {
+                ids[i] = new_seg(mem, 1 + next_random(&state) % SMALL_WORDS);
+        }
+        begin(t);
+        for (int i = 0; i < CHURN_OPS; i++) {
+                uint32_t r = next_random(&state);
+                uint32_t slot = r % LIVE_SEGMENTS;
+                free_segment(mem, ids[slot]);
+                ids[slot] = new_seg(mem, 1 + (r >> 16) % (2 * SMALL_WORDS));
+        }
+        end(t);
+        free_memory(mem);
+        return 2 * (uint64_t)CHURN_OPS;
+}
+
+/*
+*       Description: Reads (load_sequential) or writes (store_sequential)
+*       every word of a 4MB segment in order, a number of times.
+*/
+static uint64_t load_sequential(struct timing *t)
+{
+        memory mem = new_bench_memory();
+        uint32_t seg = new_seg(mem, HUGE_WORDS);
+        uint32_t sum = 0;
+        begin(t);
+        for (int pass = 0; pass < PASSES; pass++) {
+                for (uint32_t i = 0; i < HUGE_WORDS; i++) {
+                        sum += get_memory(mem, seg, i);
+                }
+        }
+        end(t);
+        sink = sum;
+        free_memory(mem);
+        return (uint64_t)PASSES * HUGE_WORDS;
+}
+
+static uint64_t store_sequential(struct timing *t)
+{
+        memory mem = new_bench_memory();
+        uint32_t seg = new_seg(mem, HUGE_WORDS);
+        begin(t);
+        for (int pass = 0; pass < PASSES; pass++) {
+                for (uint32_t i = 0; i < HUGE_WORDS; i++) {
+                        set_word(mem, seg, i, i + pass);
+                }
+        }
+        end(t);
+        sink = get_memory(mem, seg, HUGE_WORDS - 1);
+        free_memory(mem);
+        return (uint64_t)PASSES * HUGE_WORDS;
+}
+
+/*
+*       Description: Reads (load_random) or writes (store_random) random
+*       words of LIVE_SEGMENTS segments of SMALL_WORDS words each.
+*/
+static uint64_t load_random(struct timing *t)
+{
+        memory mem = new_bench_memory();
+        for (int i = 0; i < LIVE_SEGMENTS; i++) {
+                new_seg(mem, SMALL_WORDS);
+        }
+        uint64_t state = 0x9e3779b97f4a7c15;
+        uint32_t sum = 0;
+        begin(t);
+        for (int i = 0; i < RANDOM_OPS; i++) {
+                uint32_t r = next_random(&state);
+                sum += get_memory(mem, 1 + r % LIVE_SEGMENTS,
+                                  (r >> 16) % SMALL_WORDS);
+        }
+        end(t);
+        sink = sum;
+        free_memory(mem);
+        return RANDOM_OPS;
+}
+
+static uint64_t store_random(struct timing *t)
+{
+        memory mem = new_bench_memory();
+        for (int i = 0; i < LIVE_SEGMENTS; i++) {
+                new_seg(mem, SMALL_WORDS);
+        }
+        uint64_t state = 0x9e3779b97f4a7c15;
+        begin(t);
+        for (int i = 0; i < RANDOM_OPS; i++) {
+                uint32_t r = next_random(&state);
+                set_word(mem, 1 + r % LIVE_SEGMENTS, (r >> 16) % SMALL_WORDS,
+                         r);
+        }
+        end(t);
+        sink = get_memory(mem, 1, 0);
+        free_memory(mem);
+        return RANDOM_OPS;
+}
+
+/*
+*       Description: Maps a 4MB segment of instruction words, for the load
+*       program workloads.
+*/
+static uint32_t new_program_segment(memory mem)
+{
+        uint32_t seg = new_seg(mem, HUGE_WORDS);
+        uint64_t state = 0x853c49e6748fea9b;
+        for (uint32_t i = 0; i < HUGE_WORDS; i++) {
+                set_word(mem, seg, i, next_random(&state));
+        }
+        return seg;
+}
+
+/*
+*       Description: Loads the same 4MB segment as the program over and
+*       over (and fetches its decoded copy, as the instruction loop does),
+*       with no writes between: the sharing path, which copies nothing.
+*/
+static uint64_t loadp_shared(struct timing *t)
+{
+        memory mem = new_bench_memory();
+        uint32_t seg = new_program_segment(mem);
+        begin(t);
+        for (int i = 0; i < LOADP_OPS; i++) {
+                duplicate_instructions(mem, seg);
+                decode_program(mem);
+        }
+        end(t);
+        free_memory(mem);
+        return LOADP_OPS;
+}
+
+/*
+*       Description: Loads a 4MB segment as the program, then writes a word
+*       of the segment, as self-modifying programs do: each write copies
+*       the words, and each load decodes them again.
+*/
+static uint64_t loadp_modified(struct timing *t)
+{
+        memory mem = new_bench_memory();
+        uint32_t seg = new_program_segment(mem);
+        begin(t);
+        for (int i = 0; i < LOADP_COPIES; i++) {
+                duplicate_instructions(mem, seg);
+                decode_program(mem);
+                set_word(mem, seg, i, i);
+        }
+        end(t);
+        free_memory(mem);
+        return LOADP_COPIES;
+}
+
+static const struct workload {
+        const char *name;
+        uint64_t (*run)(struct timing *t);
+} workloads[] = {
+        { "tiny_map_unmap",   tiny_map_unmap },
+        { "huge_map_unmap",   huge_map_unmap },
+        { "churn_reuse",      churn_reuse },
+        { "load_sequential",  load_sequential },
+        { "store_sequential", store_sequential },
+        { "load_random",      load_random },
+        { "store_random",     store_random },
+        { "loadp_shared",     loadp_shared },
+        { "loadp_modified",   loadp_modified },
+};
+
+#define NUM_WORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+static int compare_doubles(const void *a, const void *b)
+{
+        double x = *(const double *)a;
+        double y = *(const double *)b;
+        return (x > y) - (x < y);
+}
+
+/*
+*       Description: Runs a workload a number of times and prints its JSON
+*       line.
+*
+*       In/Out Expectations: Expects the workload and the number of runs.
+*       Returns nothing.
+*/
+static void bench_workload(const struct workload *w, int runs)
+{
+        double ns[MAX_RUNS];
+        uint64_t ops = 0;
+        uint64_t allocated = 0;
+        for (int i = 0; i < runs; i++) {
+                struct timing t;
+                ops = w->run(&t);
+                ns[i] = t.seconds * 1e9 / ops;
+                allocated = t.allocations;
+        }
+        qsort(ns, runs, sizeof(ns[0]), compare_doubles);
+        double median = (runs % 2 == 1) ? ns[runs / 2] :
+                        (ns[runs / 2 - 1] + ns[runs / 2]) / 2;
+
+        printf("{\"workload\": \"%s\", \"runs\": %d, \"ops\": %" PRIu64
+               ", \"median_ns_per_op\": %.2f, \"min_ns_per_op\": %.2f, "
+               "\"allocations_per_op\": %.4f}\n", w->name, runs, ops,
+               median, ns[0], (double)allocated / ops);
+        fflush(stdout);
+}
+
+/*
+*       Description: Parses the options and runs the chosen workloads (all
+*       of them if none are named).
+*
+*       In/Out Expectations: Expects the options in the usage line above.
+*       Returns exit failure on bad arguments, otherwise exit success.
+*/
+int main(int argc, char *argv[])
+{
+        int runs = DEFAULT_RUNS;
+        int opt;
+        while ((opt = getopt(argc, argv, "n:")) != -1) {
+                runs = (opt == 'n') ? atoi(optarg) : 0;
+        }
+        if (runs < 1 || runs > MAX_RUNS) {
+                fprintf(stderr, "Usage: %s [-n runs (1-%d)] [workload ...]"
+                        "\n", argv[0], MAX_RUNS);
+                return EXIT_FAILURE;
+        }
+
+        for (int j = optind; j < argc; j++) {
+                bool known = false;
+                for (size_t i = 0; i < NUM_WORKLOADS; i++) {
+                        known = known ||
+                                strcmp(argv[j], workloads[i].name) == 0;
+                }
+                if (!known) {
+                        fprintf(stderr, "Error: no workload named %s.\n",
+                                argv[j]);
+                        return EXIT_FAILURE;
+                }
+        }
+
+        for (size_t i = 0; i < NUM_WORKLOADS; i++) {
+                bool chosen = (optind == argc);
+                for (int j = optind; j < argc; j++) {
+                        chosen = chosen ||
+                                 strcmp(argv[j], workloads[i].name) == 0;
+                }
+                if (chosen) {
+                        bench_workload(&workloads[i], runs);
+                }
+        }
+        return EXIT_SUCCESS;
+}
@@ -7,100 +7,422 @@
 *
 *       This file contains the implementations for the memory type, which is a 
 *       data type that emulates a memory system. The memory struct 
-*       contains a memory_seq, which is a Seq_T that holds mapped memory 
-*       segments. The memory segments are also represented as Seq_Ts, which 
-*       then hold uint32_t words. The memory struct also contains an 
-*       unmapped_ids Seq_T, which holds the segment ids of all of the unmapped
-*       segments.
+*       contains a segment table, which is a flat, contiguous array of
+*       segment descriptors indexed by segment id. Each descriptor holds a
+*       pointer to a raw array of uint32_t words and the segment's length,
+*       so loads and stores are a single array index away. Load program 
+*       lets segment 0 share another segment's words until either side is
+*       written; a shared array has a reference counted share record, which
+*       also holds the array's pre-decoded copy once it has been run as 
+*       segment 0. The ids of unmapped segments are kept on a free list 
+*       threaded through their own descriptors, so mapping and unmapping 
+*       never allocate anything but the words themselves. Small segments 
+*       take their words from per-size-class slabs and give them back to a
+*       free list for their class when unmapped; larger ones use malloc.
 *   
 ******************************************************************************/
 
 #include <stdio.h>
 #include <stdbool.h>
-#include "seq.h"
 #include "memory_type.h"
-#include "assert.h"
+#include <assert.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <inttypes.h>
+#include <string.h>
+#include "um_decode.h"
+
+#define INITIAL_SEGMENTS 16
+#define NO_ID UINT32_MAX
+
+/* Slab blocks are 2, 4, 8, 16, 32 or 64 words; longer segments use malloc */
+#define SIZE_CLASSES 6
+#define MAX_SLAB_WORDS (2u << (SIZE_CLASSES - 1))
+#define CHUNK_BYTES 65536
+/* Each chunk starts with a count of the memories using it (see fork) */
+#define CHUNK_HEADER 64
+
+/*
+*       Description: Bookkeeping for a word array that is shared between 
+*       segments or has been decoded. refs counts the segments using the
+*       array; decoded is NULL until the array is run as segment 0. A free
+*       record has refs 0 and holds the index of the next free record in
+*       next_free. owners is NULL unless the array is also shared with 
+*       other memories by fork_memory, in which case it points to a count 
+*       (updated atomically) of the memories whose records use the array;
+*       such an array is never written in place while others use it.
+*/
+struct share {
+        uint32_t refs;
+        uint32_t next_free;
+        Um_decoded *decoded;
+        uint32_t *owners;
+};
 
 struct memory {
-        Seq_T memory_seq; 
-        Seq_T unmapped_ids; 
+        struct segment *segments;
+        uint32_t num_segments;
+        uint32_t capacity;
+        uint32_t free_ids;
+        struct share *shares;
+        uint32_t num_shares;
+        uint32_t share_capacity;
+        uint32_t free_share;
+        void *free_blocks[SIZE_CLASSES];
+        void **chunks;
+        uint32_t num_chunks;
 };
 
+/*
+*       Description: A function that gets the size class of a small 
+*       segment, the smallest class whose blocks can hold its words (and
+*       always at least a free list link).
+*
+*       In/Out Expectations: Expects a length of at most MAX_SLAB_WORDS.
+*       Returns a class between 0 and SIZE_CLASSES - 1; class c holds 
+*       blocks of 2 << c words.
+*/
+static inline int size_class(uint32_t length)
+{
+        if (length <= 2) {
+                return 0;
+        }
+        return 31 - __builtin_clz(length - 1);
+}
+
+/*
+*       Description: A function that carves a new chunk into blocks of one
+*       size class and puts them all on that class's free list.
+*
+*       In/Out Expectations: Expects a valid memory type and a size class
+*       whose free list is empty. Returns nothing.
+*/
+static void refill_class(memory mem, int class)
+{
+        char *chunk = malloc(CHUNK_BYTES);
+        assert(chunk != NULL);
+        *(uint32_t *)chunk = 1;
+        mem->chunks = realloc(mem->chunks, 
+                              (mem->num_chunks + 1) * sizeof(void *));
+        assert(mem->chunks != NULL);
+        mem->chunks[mem->num_chunks++] = chunk;
+
+        size_t block_bytes = (2u << class) * sizeof(uint32_t);
+        for (size_t offset = CHUNK_HEADER; offset + block_bytes <= CHUNK_BYTES;
+             offset += block_bytes) {
+                void **block = (void **)(chunk + offset);
+                *block = mem->free_blocks[class];
+                mem->free_blocks[class] = block;
+        }
+}
+
+/*
+*       Description: A function that allocates the word array for a 
+*       segment, from a slab block if the segment is small.
+*
+*       In/Out Expectations: Expects a valid memory type and a segment 
+*       length. Zero-fills the words when zero is true. Returns an array of
+*       at least length words, to be given back with free_words.
+*/
+static uint32_t *alloc_words(memory mem, uint32_t length, bool zero)
+{
+        if (length > MAX_SLAB_WORDS) {
+                uint32_t *words = zero ? calloc(length, sizeof(uint32_t)) :
+                                         malloc(length * sizeof(uint32_t));
+                assert(words != NULL);
+                return words;
+        }
+
+        int class = size_class(length);
+        if (mem->free_blocks[class] == NULL) {
+                refill_class(mem, class);
+        }
+        void **block = mem->free_blocks[class];
+        mem->free_blocks[class] = *block;
+        if (zero) {
+                memset(block, 0, length * sizeof(uint32_t));
+        }
+        return (uint32_t *)block;
+}
+
+/*
+*       Description: A function that gives back a word array from 
+*       alloc_words, putting slab blocks on their class's free list.
+*
+*       In/Out Expectations: Expects a valid memory type, an array from 
+*       alloc_words, and the length it was allocated for. Returns nothing.
+*/
+static void free_words(memory mem, uint32_t *words, uint32_t length)
+{
+        if (length > MAX_SLAB_WORDS) {
+                free(words);
+                return;
+        }
+        int class = size_class(length);
+        void **block = (void **)words;
+        *block = mem->free_blocks[class];
+        mem->free_blocks[class] = block;
+}
+
+/*
+*       Description: A function that gives a segment a share record, if it
+*       does not have one yet.
+*
+*       In/Out Expectations: Expects a valid memory type and a mapped 
+*       segment. Returns the segment's share record, which has one 
+*       reference when newly made. The pointer is only good until the next
+*       record is made.
+*/
+static struct share *attach_share(memory mem, uint32_t seg)
+{
+        struct segment *segment = &mem->segments[seg];
+        if (segment->share == NO_SHARE) {
+                uint32_t index = mem->free_share;
+                if (index != NO_SHARE) {
+                        mem->free_share = mem->shares[index].next_free;
+                } else {
+                        index = ++mem->num_shares;
+                        if (index == mem->share_capacity) {
+                                mem->share_capacity *= 2;
+                                mem->shares = realloc(mem->shares, 
+                                                      mem->share_capacity *
+                                                      sizeof(struct share));
+                                assert(mem->shares != NULL);
+                        }
+                }
+                mem->shares[index].refs = 1;
+                mem->shares[index].decoded = NULL;
+                mem->shares[index].owners = NULL;
+                segment->share = index;
+        }
+        return &mem->shares[segment->share];
+}
+
+/*
+*       Description: A function that drops a memory's claim on a word array
+*       it may share with other memories.
+*
+*       In/Out Expectations: Expects a share record whose last segment has 
+*       just let go of its array. Clears the record's owners. Returns true 
+*       if no other memory uses the array, so it can be freed.
+*/
+static bool drop_owner(struct share *share)
+{
+        uint32_t *owners = share->owners;
+        if (owners == NULL) {
+                return true;
+        }
+        share->owners = NULL;
+        if (__atomic_sub_fetch(owners, 1, __ATOMIC_ACQ_REL) == 0) {
+                free(owners);
+                return true;
+        }
+        return false;
+}
+
+/*
+*       Description: A function that checks whether a memory is the only
+*       one using a word array, taking the array back as its own if so 
+*       (nothing can share it again except a fork of this memory).
+*
+*       In/Out Expectations: Expects a share record. Returns true if the
+*       array can be written without affecting another memory.
+*/
+static bool sole_owner(struct share *share)
+{
+        if (share->owners == NULL) {
+                return true;
+        }
+        if (__atomic_load_n(share->owners, __ATOMIC_ACQUIRE) == 1) {
+                free(share->owners);
+                share->owners = NULL;
+                return true;
+        }
+        return false;
+}
+
+/*
+*       Description: A function that drops a segment's use of its word 
+*       array, freeing the array (and its decoded copy) once no segment 
+*       uses it.
+*
+*       In/Out Expectations: Expects a valid memory type and a segment id.
+*       Leaves the segment's descriptor untouched. Returns nothing.
+*/
+static void release_words(memory mem, uint32_t seg)
+{
+        struct segment *segment = &mem->segments[seg];
+        if (segment->share == NO_SHARE) {
+                free_words(mem, segment->words, segment->length);
+                return;
+        }
+        struct share *share = &mem->shares[segment->share];
+        if (--share->refs == 0) {
+                if (drop_owner(share)) {
+                        free_words(mem, segment->words, segment->length);
+                }
+                free(share->decoded);
+                share->decoded = NULL;
+                share->next_free = mem->free_share;
+                mem->free_share = segment->share;
+        }
+}
+
+/*
+*       Description: A function that gives a segment a word array of its 
+*       own before it is written, copying the words out of a shared array.
+*
+*       In/Out Expectations: Expects a valid memory type and a mapped 
+*       segment whose words are shared. Leaves the segment with an unshared
+*       copy of the same words and no share record. Returns nothing.
+*/
+static void unshare_segment(memory mem, uint32_t seg)
+{
+        struct segment *segment = &mem->segments[seg];
+        uint32_t *copy = alloc_words(mem, segment->length, false);
+        memcpy(copy, segment->words, segment->length * sizeof(uint32_t));
+        release_words(mem, seg);
+        segment->words = copy;
+        segment->share = NO_SHARE;
+}
+
 
 /*
 *       Description: A function that creates a new struct of type memory,
-*       which holds two sequences. One sequence represents our memory, with
-*       each element (segmeent) of the sequence holding a sequence of words. 
-*       The other sequence holds the id numbers, or index numbers in the
-*       first sequence that have been unmapped with the unmap operation.
-*       In this function, both sequences are set as empty.
+*       which holds a table of segment descriptors and a list of ids.
+*       The table represents our memory, with each entry (segment) holding
+*       an array of words. The list holds the id numbers, or index 
+*       numbers in the table that have been unmapped with the unmap 
+*       operation. In this function, the table and list are set as empty.
 *
 *       In/Out Expectations: Expects nothing, only that the struct of memory
-*       has been defined. Returns a memory struct type populated with
-*       empty sequences. 
+*       has been defined. Returns a memory struct type with an empty segment
+*       table and an empty list of unmapped ids. 
 *       Memory expected to be freed by user (using memory_free)
 */
 memory new_memory() 
 {
-        Seq_T sequence = Seq_new(0);
-        Seq_T ids = Seq_new(0);
-
         memory new = malloc(sizeof(*new));
         assert(new != NULL);
 
-        new->memory_seq = sequence;
-        new->unmapped_ids = ids;
+        new->segments = malloc(INITIAL_SEGMENTS * sizeof(struct segment));
+        assert(new->segments != NULL);
+        new->num_segments = 0;
+        new->capacity = INITIAL_SEGMENTS;
+        new->free_ids = NO_ID;
+        new->shares = malloc(INITIAL_SEGMENTS * sizeof(struct share));
+        assert(new->shares != NULL);
+        new->num_shares = 0;
+        new->share_capacity = INITIAL_SEGMENTS;
+        new->free_share = NO_SHARE;
+        for (int i = 0; i < SIZE_CLASSES; i++) {
+                new->free_blocks[i] = NULL;
+        }
+        new->chunks = NULL;
+        new->num_chunks = 0;
 
         return new;
 }
 
 /*
-*       Description: A function that adds an id to the sequence in the memory
-*       struct holding the ids of sequence segments that have been unmapped. 
+*       Description: A function that adds an id to the list in the memory
+*       struct holding the ids of segments that have been unmapped. The 
+*       most recently unmapped id is reused first, while its descriptor is
+*       still in cache.
 *
 *       In/Out Expectations: Expects a valid memory type, and a uint32_t
-*       representning the index of the segment in memory that has been 
-*       uunmapped.
-*       Returns nothing, adds the passed id to the sequence of unmapped ids. 
+*       representning the index of a segment in memory that has been 
+*       unmapped, whose descriptor can be used as a list link.
+*       Returns nothing, adds the passed id to the list of unmapped ids. 
 */
-void add_to_unmapped_seq(memory curr, uint32_t id) 
+static inline void push_free_id(memory mem, uint32_t id) 
 {
-        Seq_addhi(curr->unmapped_ids, (void *)(uintptr_t)id);
+        mem->segments[id].length = mem->free_ids;
+        mem->free_ids = id;
 }
 
 /*
-*       Description: A function that adds a sequence of words (memory segment)
-*       to the memory at the next avaliable slot. This is either at the end of
-*       the memory, or at the first slot previously unmapped.
+*       Description: A function that doubles the number of descriptors the
+*       segment table can hold.
 *
-*       In/Out Expectations: Expects a valid memory type, and an int reprenting
-*       how many words will be in memory segment that will be added. Returns
-*       the index in memory that the new segment has been added to. 
+*       In/Out Expectations: Expects a valid memory type whose table is full.
+*       Reallocates the table, keeping every existing descriptor. Returns
+*       nothing.
 */
-uint32_t new_seg(memory mem, int length) 
+static void expand_table(memory mem)
 {
-        Seq_T segment = Seq_new(length);
-        for (int i = 0; i < length; i++){
-                Seq_addhi(segment, (void *)(uintptr_t)0);
-        }
+        mem->capacity *= 2;
+        mem->segments = realloc(mem->segments, 
+                                mem->capacity * sizeof(struct segment));
+        assert(mem->segments != NULL);
+}
 
+/*
+*       Description: A function that puts a word array in the memory at 
+*       the next avaliable slot: the most recently unmapped id, or else the
+*       end of the segment table.
+*
+*       In/Out Expectations: Expects a valid memory type, an array from
+*       alloc_words, and its length. Returns the new segment's id.
+*/
+static uint32_t add_segment(memory mem, uint32_t *words, uint32_t length)
+{
         uint32_t id;
-
-        /**/
-        if (Seq_length(mem->unmapped_ids) == 0){
-                id = Seq_length(mem->memory_seq);
-                Seq_addhi(mem->memory_seq, segment);
+        if (mem->free_ids == NO_ID) {
+                if (mem->num_segments == mem->capacity) {
+                        expand_table(mem);
+                }
+                id = mem->num_segments++;
         } else {
-                id = (uint32_t)(uintptr_t)Seq_remlo(mem->unmapped_ids);
-                Seq_put(mem->memory_seq, id, segment);
+                id = mem->free_ids;
+                mem->free_ids = mem->segments[id].length;
         }
+
+        struct segment *segment = &mem->segments[id];
+        segment->words = words;
+        segment->length = length;
+        segment->share = NO_SHARE;
         
         return id;
 }
 
+/*
+*       Description: A function that adds a zero-filled array of words 
+*       (memory segment) to the memory at the next avaliable slot. This is 
+*       either at the end of the memory, or at the first slot previously 
+*       unmapped.
+*
+*       In/Out Expectations: Expects a valid memory type, and an int reprenting
+*       how many words will be in memory segment that will be added. Returns
+*       the index in memory that the new segment has been added to. 
+*/
+uint32_t new_seg(memory mem, int length) 
+{
+        return add_segment(mem, alloc_words(mem, length, true), length);
+}
+
+/*
+*       Description: A function that adds an already filled array of words
+*       to the memory as a new segment, at the same slot new_seg would use.
+*       A large array becomes the segment's storage without being copied;
+*       a small one is copied into a slab block.
+*
+*       In/Out Expectations: Expects a valid memory type, an array of words
+*       allocated with malloc, and its length. The memory takes ownership
+*       of the array and frees it when the segment is freed. Returns the 
+*       index in memory that the new segment has been added to.
+*/
+uint32_t adopt_seg(memory mem, uint32_t *words, int length)
+{
+        if ((uint32_t)length <= MAX_SLAB_WORDS) {
+                uint32_t *block = alloc_words(mem, length, false);
+                memcpy(block, words, length * sizeof(uint32_t));
+                free(words);
+                words = block;
+        }
+        return add_segment(mem, words, length);
+}
+
 /*
 *       Description: A function that gets a word in memory given the segment
 *       and index within the segment that it's located at. 
@@ -112,110 +434,413 @@ uint32_t new_seg(memory mem, int length)
 *       specified index of the specifed segment. Note: behavior
 *       undefined when the memory struct doesn't have a word mapped in the 
 *       given segment at the given index.
-*       TO DO: CHECK THAT THE LAST LINE IS TRUE. 
 */
 uint32_t get_memory(memory mem, uint32_t seg, int index) 
 {
-        Seq_T segment_to_get = Seq_get(mem->memory_seq, seg);
-        return (uint32_t)(uintptr_t)Seq_get(segment_to_get, index);
+        return mem->segments[seg].words[index];
 }
 
 /*
-*       Description: A function that sets a word in memory given the segment
-*       and adds it to the end of the segment. 
+*       Description: A function that checks whether a segment id is mapped,
+*       for the checked instruction loop.
 *
-*       In/Out Expectations: Expects a valid memory type, a uint32_t 
-*       representing the segment to add the word, and a uint32_t of the 
-*       new word to add.
-*       Returns nothing.  Note: behavior undefined when the specified segment 
-*       isn't mapped.
+*       In/Out Expectations: Expects a valid memory type and any uint32_t.
+*       Returns true if the id names a mapped segment (segment 0 counts 
+*       until it is unmapped).
 */
-void set_memory(memory mem, uint32_t seg, uint32_t word) 
+bool segment_mapped(memory mem, uint32_t seg)
 {
-        Seq_T segment_to_add = Seq_get(mem->memory_seq, seg);
-	Seq_addhi(segment_to_add, (void *)(uintptr_t)word);
+        return seg < mem->num_segments && mem->segments[seg].words != NULL;
+}
+
+/*
+*       Description: A function that gets the number of words in a segment.
+*
+*       In/Out Expectations: Expects a valid memory type and a uint32_t
+*       representing a mapped segment. Returns its length.
+*/
+uint32_t segment_length(memory mem, uint32_t seg)
+{
+        return mem->segments[seg].length;
+}
+
+/*
+*       Description: A function that compares two memories: which segments
+*       are mapped, their lengths, and their words.
+*
+*       In/Out Expectations: Expects two valid memory types and places to
+*       store where they differ. Returns true if they are the same; 
+*       otherwise false, with *seg set to the first segment that differs 
+*       and *index to the first word in it that differs (or UINT32_MAX if 
+*       the segment is mapped in only one of them or its lengths differ).
+*/
+bool memory_equal(memory a, memory b, uint32_t *seg, uint32_t *index)
+{
+        uint32_t count = a->num_segments > b->num_segments ? 
+                         a->num_segments : b->num_segments;
+        for (uint32_t i = 0; i < count; i++) {
+                bool mapped = segment_mapped(a, i);
+                *seg = i;
+                *index = UINT32_MAX;
+                if (mapped != segment_mapped(b, i)) {
+                        return false;
+                }
+                if (!mapped) {
+                        continue;
+                }
+                uint32_t length = a->segments[i].length;
+                if (length != b->segments[i].length) {
+                        return false;
+                }
+                const uint32_t *x = a->segments[i].words;
+                const uint32_t *y = b->segments[i].words;
+                if (x == y || memcmp(x, y, length * sizeof(*x)) == 0) {
+                        continue;
+                }
+                *index = 0;
+                while (x[*index] == y[*index]) {
+                        (*index)++;
+                }
+                return false;
+        }
+        return true;
+}
+
+/*
+*       Description: A function that gets the array of words backing a 
+*       segment, so that a caller can read it without a call per word.
+*
+*       In/Out Expectations: Expects a valid memory type and a uint32_t
+*       representing a mapped segment. Returns a pointer to the segment's 
+*       words, which stays valid until the segment is unmapped, replaced by
+*       duplicate_instructions, or copied by set_word.
+*/
+uint32_t *get_segment(memory mem, uint32_t seg)
+{
+        return mem->segments[seg].words;
 }
 
 /*
 *       Description: A function that sets a word in memory given the segment
-*       and index within the segment that it should be located at. 
+*       and index within the segment that it should be located at. If the
+*       segment shares its words with another segment, it first gets a 
+*       copy of its own; if its words have been decoded, the decoded copy
+*       of the word is updated too.
 *
 *       In/Out Expectations: Expects a valid memory type, a uint32_t 
 *       representing the segment to add the word, and a int that represents
 *       the index in the in the segment to add the new word, and a uint32_t 
-*       of the new word to add. Returns nothing.  
+*       of the new word to add. Returns true if the segment had to be 
+*       copied, so pointers from get_segment or get_decoded are stale.
 *       Note: behavior undefined when the specified segment 
 *       isn't mapped.
 */
-void set_word(memory mem, uint32_t seg, uint32_t index, uint32_t word)
+bool set_word(memory mem, uint32_t seg, uint32_t index, uint32_t word)
+{
+        struct segment *segment = &mem->segments[seg];
+        if (segment->share == NO_SHARE) {
+                segment->words[index] = word;
+                return false;
+        }
+
+        struct share *share = &mem->shares[segment->share];
+        if (share->refs > 1 || !sole_owner(share)) {
+                unshare_segment(mem, seg);
+                segment->words[index] = word;
+                return true;
+        }
+        segment->words[index] = word;
+        if (share->decoded != NULL) {
+                patch_decoded(segment->words, share->decoded, 
+                              segment->length, index);
+        }
+        return false;
+}
+
+/*
+*       Description: A function that builds the pre-decoded copy of segment 
+*       0 from its words, unless its words already have one.
+*
+*       In/Out Expectations: Expects a valid memory type with segment 0 
+*       mapped. Allocates the decoded array, which is freed along with the
+*       words. Compiled to nothing with UM_NO_PREDECODE. Returns nothing.
+*/
+void decode_program(memory mem)
+{
+#ifndef UM_NO_PREDECODE
+        struct segment *program = &mem->segments[0];
+        struct share *share = attach_share(mem, 0);
+        if (share->decoded != NULL) {
+                return;
+        }
+        share->decoded = malloc((program->length > 0 ? program->length : 1) *
+                                sizeof(Um_decoded));
+        assert(share->decoded != NULL);
+        decode_segment(program->words, share->decoded, program->length);
+#else
+        (void)mem;
+#endif
+}
+
+/*
+*       Description: A function that gets the pre-decoded copy of segment 0.
+*
+*       In/Out Expectations: Expects a valid memory type. Returns the array
+*       built by decode_program, building it first if segment 0's words 
+*       have none. The array is patched in place by stores to segment 0, 
+*       but must be fetched again after duplicate_instructions or after 
+*       set_word reports a copy.
+*/
+Um_decoded *get_decoded(memory mem)
 {
-        Seq_T segment_to_add = Seq_get(mem->memory_seq, seg);
-        Seq_put(segment_to_add, index, (void *)(uintptr_t)word);
+        decode_program(mem);
+        return mem->shares[mem->segments[0].share].decoded;
+}
+
+/*
+*       Description: A function that gets the segment table itself, for 
+*       generated code that indexes it without calls.
+*
+*       In/Out Expectations: Expects a valid memory type. Returns the table,
+*       indexed by segment id, which stays valid until the next new_seg or
+*       adopt_seg (either may move it).
+*/
+Um_segment *segment_table(memory mem)
+{
+        return mem->segments;
 }
 
 /*
 *       Description: A function that copies a segment in memory, and replaces
 *       the first segment in memory, storing the instructions, with that 
-*       memory segment copy. 
+*       memory segment copy. The copy is made lazily: segment 0 shares the
+*       other segment's words until either of them is written, so this 
+*       takes constant time however long the segment is.
 *       
 *       In/Out Expectations: Expects a valid memory type, and a uint32_t 
-*       representing the index of the segment to copy. Deallocates and deletes
-*       the memory segment currently in the first index of memory. 
-*       Allocates memory for the copy of the segment and adds it to the 
-*       first memory index. Returns nothing.  
+*       representing the index of the segment to copy. Releases the words
+*       currently used by the first index of memory. Returns nothing.  
 *       Note: behavior undefined when the specified segment isn't mapped.
 */
 void duplicate_instructions(memory mem, uint32_t seg)
 {
-        free_segment(mem, 0);
+        struct share *share = attach_share(mem, seg);
+        share->refs++;
 
-        Seq_T old_seq = Seq_get(mem->memory_seq, seg);
-        Seq_T new_seq = Seq_new(Seq_length(old_seq));
-
-        for (int i = 0; i < Seq_length(old_seq); i++) {
-                Seq_addhi(new_seq, Seq_get(old_seq, i));
-        }
-        Seq_put(mem->memory_seq, 0, new_seq);
+        release_words(mem, 0);
+        mem->segments[0] = mem->segments[seg];
 }
 
 
 /*
 *       Description: A function that frees memory associated with one segment
 *       in memory, and adds the index of the segment that was freed to our
-*       sequence of unmapped segments.
+*       list of unmapped segments.
 *       
 *       In/Out Expectations: Expects a valid memory type, and a uint32_t 
-*       representing the index of the segment to free. Deallocates and deletes
-*       the memory segment if the memory segment has been mapped. Returns
-*       nothing.
+*       representing the index of the segment to free. Releases the 
+*       segment's words, which are deallocated once no other segment shares
+*       them. Returns nothing.
 */
 void free_segment(memory mem, uint32_t id) 
 {
+        struct segment *segment = &mem->segments[id];
+        release_words(mem, id);
+        segment->words = NULL;
+        segment->length = 0;
+        segment->share = NO_SHARE;
         if(id != 0){
-                add_to_unmapped_seq(mem, id);
+                push_free_id(mem, id);
         }
-        Seq_T segment = Seq_get(mem->memory_seq, id);
-        if (segment != NULL) {
-                Seq_free(&segment);
-        }
-        Seq_put(mem->memory_seq, id, NULL);
-        assert(segment == NULL);
 }
 
 /*
 *       Description: A function that frees all segments in a memory struct.
 *       
-*       In/Out Expectations: Expects a valid memory type. Calls the
-*       free_segment function to free all words in each segment. Returns
-*       nothing.
+*       In/Out Expectations: Expects a valid memory type. Releases the 
+*       words of each segment, then frees the segment table and share
+*       records. Returns nothing.
 */
 void free_memory(memory mem) 
 {
-	for (int i = 0; i < Seq_length(mem->memory_seq); i++) {
-                free_segment(mem, i);
+	for (uint32_t i = 0; i < mem->num_segments; i++) {
+                if (mem->segments[i].words != NULL) {
+                        release_words(mem, i);
+                }
 	}
-	Seq_free(&(mem->memory_seq));
-        Seq_free(&(mem->unmapped_ids));
+        for (uint32_t i = 0; i < mem->num_chunks; i++) {
+                if (__atomic_sub_fetch((uint32_t *)mem->chunks[i], 1, 
+                                       __ATOMIC_ACQ_REL) == 0) {
+                        free(mem->chunks[i]);
+                }
+        }
+        free(mem->chunks);
+        free(mem->segments);
+        free(mem->shares);
         free(mem);
 }
 
+/*
+*       Description: A function that forks a memory: the child has the 
+*       same segments, ids and free id list, but shares every word array
+*       with the parent copy-on-write, a segment at a time, so forking 
+*       copies only the segment table. Either memory copies a segment the 
+*       first time it writes to it while the other still uses it. Slab 
+*       chunks are shared too, and freed with the last memory using them.
+*
+*       In/Out Expectations: Expects a valid memory type that isn't 
+*       running. Returns the child, to be freed with free_memory. Parent 
+*       and child can afterwards be run (and freed) independently, on 
+*       different threads; each keeps its own decoded copy of segment 0.
+*/
+memory fork_memory(memory mem)
+{
+        for (uint32_t i = 0; i < mem->num_segments; i++) {
+                if (mem->segments[i].words != NULL) {
+                        attach_share(mem, i);
+                }
+        }
+        for (uint32_t i = 1; i <= mem->num_shares; i++) {
+                struct share *share = &mem->shares[i];
+                if (share->refs == 0) {
+                        continue;
+                }
+                if (share->owners == NULL) {
+                        share->owners = malloc(sizeof(uint32_t));
+                        assert(share->owners != NULL);
+                        *share->owners = 1;
+                }
+                __atomic_add_fetch(share->owners, 1, __ATOMIC_RELAXED);
+        }
+
+        memory child = malloc(sizeof(*child));
+        assert(child != NULL);
+        *child = *mem;
+
+        child->segments = malloc(mem->capacity * sizeof(struct segment));
+        assert(child->segments != NULL);
+        memcpy(child->segments, mem->segments, 
+               mem->num_segments * sizeof(struct segment));
+
+        child->shares = malloc(mem->share_capacity * sizeof(struct share));
+        assert(child->shares != NULL);
+        memcpy(child->shares, mem->shares, 
+               (mem->num_shares + 1) * sizeof(struct share));
+        for (uint32_t i = 1; i <= child->num_shares; i++) {
+                child->shares[i].decoded = NULL;
+        }
+
+        for (int i = 0; i < SIZE_CLASSES; i++) {
+                child->free_blocks[i] = NULL;
+        }
+        child->chunks = malloc((mem->num_chunks > 0 ? mem->num_chunks : 1) *
+                               sizeof(void *));
+        assert(child->chunks != NULL);
+        for (uint32_t i = 0; i < mem->num_chunks; i++) {
+                child->chunks[i] = mem->chunks[i];
+                __atomic_add_fetch((uint32_t *)mem->chunks[i], 1, 
+                                   __ATOMIC_RELAXED);
+        }
+        return child;
+}
+
+/*
+*       Description: A function that writes an image of the memory to a 
+*       file, as native 32 bit words: the number of descriptors in the 
+*       segment table and the head of the free id list, then for each 
+*       descriptor its length (or free list link) and whether it is mapped,
+*       then the words of every mapped segment in id order. Shared words
+*       are written once per segment that uses them.
+*
+*       In/Out Expectations: Expects a valid memory type and a file open 
+*       for writing. Returns false if the image couldn't be written.
+*/
+bool save_memory(memory mem, FILE *out)
+{
+        uint32_t header[2] = { mem->num_segments, mem->free_ids };
+        bool ok = fwrite(header, sizeof(uint32_t), 2, out) == 2;
+
+        for (uint32_t i = 0; ok && i < mem->num_segments; i++) {
+                uint32_t descriptor[2] = { 
+                        mem->segments[i].length, 
+                        mem->segments[i].words != NULL 
+                };
+                ok = fwrite(descriptor, sizeof(uint32_t), 2, out) == 2;
+        }
+        for (uint32_t i = 0; ok && i < mem->num_segments; i++) {
+                struct segment *segment = &mem->segments[i];
+                if (segment->words != NULL) {
+                        ok = fwrite(segment->words, sizeof(uint32_t),
+                                    segment->length, out) == 
+                             segment->length;
+                }
+        }
+        return ok;
+}
+
+/*
+*       Description: A function that rebuilds a memory from an image 
+*       written by save_memory, with the same segment ids, free id list and
+*       words. Every segment gets words of its own, and segment 0 is 
+*       decoded.
+*
+*       In/Out Expectations: Expects an image (which may be a read-only 
+*       mapping of a file) and its length in words. Returns the new memory,
+*       to be freed with free_memory, or NULL if the image is malformed.
+*/
+memory restore_memory(const uint32_t *image, size_t length)
+{
+        if (length < 2) {
+                return NULL;
+        }
+        uint32_t num_segments = image[0];
+        const uint32_t *descriptors = image + 2;
+        const uint32_t *words = descriptors + 2 * (size_t)num_segments;
+        size_t remaining = length - 2;
+        if (num_segments == 0 || remaining < 2 * (size_t)num_segments || 
+            descriptors[1] == 0) {
+                return NULL;
+        }
+        remaining -= 2 * (size_t)num_segments;
+
+        memory mem = new_memory();
+        while (mem->capacity < num_segments) {
+                expand_table(mem);
+        }
+        mem->num_segments = num_segments;
+        mem->free_ids = image[1];
+        bool ok = true;
+        for (uint32_t i = 0; i < num_segments; i++) {
+                struct segment *segment = &mem->segments[i];
+                segment->length = descriptors[2 * i];
+                segment->share = NO_SHARE;
+                segment->words = NULL;
+                if (!ok || descriptors[2 * i + 1] == 0) {
+                        continue;
+                }
+                if (remaining < segment->length) {
+                        ok = false;
+                        continue;
+                }
+                segment->words = alloc_words(mem, segment->length, false);
+                memcpy(segment->words, words, 
+                       segment->length * sizeof(uint32_t));
+                words += segment->length;
+                remaining -= segment->length;
+        }
+        /* the free list must only link unmapped ids, without a cycle */
+        uint32_t id = mem->free_ids;
+        for (uint32_t steps = 0; ok && id != NO_ID; steps++) {
+                ok = id != 0 && id < num_segments && steps < num_segments &&
+                     mem->segments[id].words == NULL;
+                if (ok) {
+                        id = mem->segments[id].length;
+                }
+        }
+        if (!ok || remaining != 0) {
+                free_memory(mem);
+                return NULL;
+        }
+        decode_program(mem);
+        return mem;
+}
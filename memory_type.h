@@ -21,19 +21,47 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
-#include "assert.h"
-#include "seq.h"
+#include <assert.h>
+#include "um_decode.h"
 
 
 typedef struct memory *memory;
 
+#define NO_SHARE 0
+
+/*
+*       Description: Describes one mapped segment. The words are stored
+*       unboxed in a raw array. share is NO_SHARE for an array that only 
+*       this segment uses and that has never been decoded, which is every 
+*       segment made by map; otherwise it is the index of the array's share
+*       record. An unmapped segment has a NULL words pointer, and its 
+*       length holds the next id on the free list (or NO_ID). The layout is
+*       public only so that code generated by um_jit can index the table;
+*       everything else goes through the functions below.
+*/
+typedef struct segment {
+        uint32_t *words;
+        uint32_t length;
+        uint32_t share;
+} Um_segment;
+
 memory new_memory();
 uint32_t get_memory(memory mem, uint32_t seg, int word);
-void set_memory(memory mem, uint32_t seg, uint32_t word);
+uint32_t *get_segment(memory mem, uint32_t seg);
+bool segment_mapped(memory mem, uint32_t seg);
+uint32_t segment_length(memory mem, uint32_t seg);
+bool memory_equal(memory a, memory b, uint32_t *seg, uint32_t *index);
 uint32_t new_seg(memory mem, int length);
+uint32_t adopt_seg(memory mem, uint32_t *words, int length);
 void free_segment(memory mem, uint32_t id);
 void free_memory(memory mem);
 void duplicate_instructions(memory mem, uint32_t seg);
-void set_word(memory mem, uint32_t seg, uint32_t index, uint32_t word);
+bool set_word(memory mem, uint32_t seg, uint32_t index, uint32_t word);
+void decode_program(memory mem);
+Um_decoded *get_decoded(memory mem);
+Um_segment *segment_table(memory mem);
+bool save_memory(memory mem, FILE *out);
+memory restore_memory(const uint32_t *image, size_t length);
+memory fork_memory(memory mem);
 
 #endif 
\ No newline at end of file
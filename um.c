@@ -14,52 +14,322 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include "um_populate.h"
 #include "um_operations.h"
-#include "assert.h"
+#include <assert.h>
 #include "memory_type.h"
-#include <sys/stat.h>
+#include "um_io.h"
+#include "um_snapshot.h"
+#include "um_trace.h"
+#include "um_cfg.h"
+#include <unistd.h>
+
+/* 
+ * Buffered output bytes that trigger a write; 0 means "when the buffer is
+ * full". Override with -DUM_FLUSH_BYTES=n.
+ */
+#ifndef UM_FLUSH_BYTES
+#define UM_FLUSH_BYTES 0
+#endif
 
 /*
-*       Description: Initializes memory and registers to read in from a file
-*       and run the program. Sets and frees memory.  
+*       Description: The command line options. filename is the program to
+*       run; profile asks for a profile of the run on stderr, and 
+*       profile_json (if not NULL) for one written as JSON to that file.
+*       jit asks for hot code to be compiled by um_jit. snapshot (if not 
+*       NULL) is the file to save the machine to when the program first 
+*       asks for input; restore (if not NULL) is a snapshot to resume 
+*       instead of loading a program. At most one of these modes (counting
+*       the two profile options as one) can be asked for. safe asks for 
+*       every instruction to be checked, and a um fault reported instead 
+*       of undefined behavior; it can only be combined with restore. trace
+*       (if not NULL) is the file to write a trace of the run to (see 
+*       um_trace), which is a mode of its own. cfg asks for the program's
+*       basic blocks (see um_cfg): on its own it prints them to stdout 
+*       instead of running the program, and with a profile it adds block
+*       and loop counts to the profile on stderr.
+*/
+struct options {
+        const char *filename;
+        bool profile;
+        const char *profile_json;
+        bool jit;
+        const char *snapshot;
+        const char *restore;
+        bool safe;
+        const char *trace;
+        bool cfg;
+};
+
+/*
+*       Description: Parses the command line into options.
 *
-*       In/Out Expectations: Expects 2 command line arguments, with the second 
-*       being a valid file name. Asserts that file size is appropriate, or 
-*       returns exit failure if file can't be opened/wasn't supplied. Otherwise
-*       returns exit success.
+*       In/Out Expectations: Expects main's arguments and an options struct
+*       to fill. Returns false, after printing the problem and a usage 
+*       message to stderr, if the arguments aren't valid.
 */
-int main(int argc, char *argv[])
+static bool parse_args(int argc, char *argv[], struct options *opts)
 {
-        if (argc != 2) {
-                fprintf(stderr, "Error: Incorrect number of arguments.\n");
-                return EXIT_FAILURE;
+        opts->filename = NULL;
+        opts->profile = false;
+        opts->profile_json = NULL;
+        opts->jit = false;
+        opts->snapshot = NULL;
+        opts->restore = NULL;
+        opts->safe = false;
+        opts->trace = NULL;
+        opts->cfg = false;
+
+        for (int i = 1; i < argc; i++) {
+                if (strcmp(argv[i], "--profile") == 0) {
+                        opts->profile = true;
+                } else if (strcmp(argv[i], "--profile-json") == 0 && 
+                           i + 1 < argc) {
+                        opts->profile_json = argv[++i];
+                } else if (strcmp(argv[i], "--safe") == 0) {
+                        opts->safe = true;
+                } else if (strcmp(argv[i], "--trace") == 0 && 
+                           i + 1 < argc) {
+                        opts->trace = argv[++i];
+                } else if (strcmp(argv[i], "--cfg") == 0) {
+                        opts->cfg = true;
+                } else if (strcmp(argv[i], "--jit") == 0) {
+                        opts->jit = true;
+                } else if (strcmp(argv[i], "--snapshot-at-input") == 0 &&
+                           i + 1 < argc) {
+                        opts->snapshot = argv[++i];
+                } else if (strcmp(argv[i], "--restore") == 0 && 
+                           i + 1 < argc) {
+                        opts->restore = argv[++i];
+                } else if (argv[i][0] != '-' && opts->filename == NULL) {
+                        opts->filename = argv[i];
+                } else {
+                        opts->filename = NULL;
+                        opts->restore = NULL;
+                        break;
+                }
         }
-        
-        /* checks that program won't run if there's an incorrect file size */
-        char *filename = argv[1];
-        struct stat st;
-        stat(filename, &st);
-        int size = st.st_size;
-        assert(size % 4 == 0);
-        
+
+        bool profiling = opts->profile || opts->profile_json != NULL;
+        int modes = profiling + opts->jit + (opts->snapshot != NULL) + 
+                    (opts->restore != NULL) + (opts->trace != NULL) +
+                    (opts->cfg && !profiling);
+        bool restoring = opts->restore != NULL;
+        if (modes > 1 || (opts->filename == NULL) != restoring ||
+            (opts->safe && modes > restoring)) {
+                fprintf(stderr, "Error: Incorrect number of arguments.\n"
+                        "Usage: %s [--safe | --jit | --profile | "
+                        "--profile-json FILE | --snapshot-at-input FILE | "
+                        "--trace FILE] program.um\n"
+                        "       %s --cfg [--profile | --profile-json FILE] "
+                        "program.um\n"
+                        "       %s [--safe] --restore FILE\n", argv[0], 
+                        argv[0], argv[0]);
+                return false;
+        }
+        return true;
+}
+
+/*
+*       Description: Runs a loaded program while profiling it, then writes
+*       the profile where the options ask for it.
+*
+*       In/Out Expectations: Expects loaded memory, registers, an 
+*       io_buffer, and the options. Returns false if the JSON file can't be
+*       written.
+*/
+static bool run_profiled(memory mem, uint32_t *registers, io_buffer io,
+                         struct options *opts)
+{
+        cfg graph = NULL;
+        if (opts->cfg) {
+                graph = new_cfg(get_segment(mem, 0), segment_length(mem, 0));
+        }
+        profile prof = new_profile();
+        execute_profiled(mem, registers, io, prof);
+
+        bool ok = true;
+        if (opts->profile) {
+                profile_report(prof, stderr);
+        }
+        if (graph != NULL) {
+                profile_report_blocks(prof, graph, stderr);
+                free_cfg(graph);
+        }
+        if (opts->profile_json != NULL) {
+                FILE *out = fopen(opts->profile_json, "w");
+                if (out == NULL) {
+                        fprintf(stderr, "Error: %s can't be written.\n",
+                                opts->profile_json);
+                        ok = false;
+                } else {
+                        profile_report_json(prof, out);
+                        fclose(out);
+                }
+        }
+        free_profile(prof);
+        return ok;
+}
+
+/*
+*       Description: Runs a loaded program up to its first input 
+*       instruction and saves a snapshot of the machine there.
+*
+*       In/Out Expectations: Expects loaded memory, registers, an 
+*       io_buffer, and the snapshot path. Returns false if the program 
+*       halted before asking for input or the snapshot can't be written.
+*/
+static bool run_to_snapshot(memory mem, uint32_t *registers, io_buffer io,
+                            const char *path)
+{
+        uint32_t pc = 0;
+        if (!execute_until_input(mem, registers, &pc, io)) {
+                fprintf(stderr, "Error: the program halted before reading "
+                        "input; no snapshot was written.\n");
+                return false;
+        }
+        if (!save_snapshot(path, mem, registers, pc)) {
+                fprintf(stderr, "Error: %s can't be written.\n", path);
+                return false;
+        }
+        return true;
+}
+
+/*
+*       Description: Runs a loaded program with every instruction checked,
+*       and reports the fault it stops on, if any.
+*
+*       In/Out Expectations: Expects loaded memory, registers, the pc to 
+*       start at, and an io_buffer. Returns false if the program faulted.
+*/
+static bool run_safe(memory mem, uint32_t *registers, uint32_t pc,
+                     io_buffer io)
+{
+        Um_fault fault;
+        if (execute_checked(mem, registers, &pc, io, &fault) == UM_HALTED) {
+                return true;
+        }
+        report_fault(&fault, stderr);
+        return false;
+}
+
+/*
+*       Description: Runs a loaded program while writing a trace of it.
+*
+*       In/Out Expectations: Expects loaded memory, registers, an 
+*       io_buffer, and the trace path. Returns false if the trace can't be
+*       written.
+*/
+static bool run_traced(memory mem, uint32_t *registers, io_buffer io,
+                       const char *path)
+{
+        FILE *out = fopen(path, "wb");
+        if (out == NULL) {
+                fprintf(stderr, "Error: %s can't be written.\n", path);
+                return false;
+        }
+        trace t = new_trace(out, mem);
+        bool ok = execute_traced(mem, registers, io, t);
+        ok = finish_trace(t) && ok;
+        free_trace(t);
+        if (fclose(out) != 0 || !ok) {
+                fprintf(stderr, "Error: %s can't be written.\n", path);
+                return false;
+        }
+        return true;
+}
+
+/*
+*       Description: Loads the program named on the command line into a new
+*       memory.
+*
+*       In/Out Expectations: Expects the program's file name. Returns the
+*       memory, or NULL (after printing why) if the file can't be opened or
+*       read or isn't a whole number of 32 bit words.
+*/
+static memory load_program_file(const char *filename)
+{
         FILE *fp = fopen(filename, "r");
         if (fp == NULL) {
                 fprintf(stderr, "Error: file can't be opened.\n");
-                return EXIT_FAILURE;
+                return NULL;
         }
         
         memory mem = new_memory();
-        uint32_t registers[8] = {0, 0, 0, 0, 0, 0, 0, 0};
-        populate_instructions(fp, mem);
-        execute_program(mem, registers);
-        free_memory(mem);
-        
-        fclose(fp);
 
-        return EXIT_SUCCESS;
+        /* checks that program won't run if there's an incorrect file size */
+        if (!populate_instructions(fp, mem)) {
+                fprintf(stderr, "Error: %s can't be read, or its size is "
+                                "not a multiple of 4 bytes.\n", filename);
+                free_memory(mem);
+                mem = NULL;
+        }
+        fclose(fp);
+        return mem;
 }
 
+/*
+*       Description: Initializes memory and registers to read in from a file
+*       and run the program. Sets and frees memory.  
+*
+*       In/Out Expectations: Expects the options parse_args accepts, with a
+*       valid file name or snapshot. Returns exit failure if the file can't
+*       be opened/wasn't supplied, or isn't a whole number of 32 bit words,
+*       or isn't a snapshot, or a requested profile or snapshot can't be 
+*       written, or a safe run faults, or a trace can't be written. 
+*       Otherwise returns exit success; --cfg on its own prints the 
+*       program's basic blocks without running it.
+*/
+int main(int argc, char *argv[])
+{
+        struct options opts;
+        if (!parse_args(argc, argv, &opts)) {
+                return EXIT_FAILURE;
+        }
+        
+        uint32_t registers[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        uint32_t pc = 0;
+        memory mem;
+        if (opts.restore != NULL) {
+                mem = load_snapshot(opts.restore, registers, &pc);
+                if (mem == NULL) {
+                        fprintf(stderr, "Error: %s isn't a readable um "
+                                "snapshot.\n", opts.restore);
+                }
+        } else {
+                mem = load_program_file(opts.filename);
+        }
+        if (mem == NULL) {
+                return EXIT_FAILURE;
+        }
 
+        if (opts.cfg && !opts.profile && opts.profile_json == NULL) {
+                cfg graph = new_cfg(get_segment(mem, 0),
+                                    segment_length(mem, 0));
+                cfg_print(graph, stdout);
+                free_cfg(graph);
+                free_memory(mem);
+                return EXIT_SUCCESS;
+        }
 
+        bool ok = true;
+        io_buffer io = new_io(STDIN_FILENO, STDOUT_FILENO, UM_FLUSH_BYTES);
+        if (opts.profile || opts.profile_json != NULL) {
+                ok = run_profiled(mem, registers, io, &opts);
+        } else if (opts.jit) {
+                execute_jit(mem, registers, io);
+        } else if (opts.snapshot != NULL) {
+                ok = run_to_snapshot(mem, registers, io, opts.snapshot);
+        } else if (opts.trace != NULL) {
+                ok = run_traced(mem, registers, io, opts.trace);
+        } else if (opts.safe) {
+                ok = run_safe(mem, registers, pc, io);
+        } else {
+                execute_from(mem, registers, pc, io);
+        }
+        free_io(io);
+        free_memory(mem);
 
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
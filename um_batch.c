@@ -0,0 +1,324 @@
+/******************************************************************************
+*       um_batch.c
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the batch driver, which runs many um jobs in one
+*       process on a work-stealing thread pool (um_pool), each on its own
+*       um_machine with in-memory input and output.
+*
+*       Usage: um_batch [-j threads] test.um ...
+*              um_batch [-j threads] -p program.um input ...
+*
+*       The first form runs unit tests the um-lab way: test.0 (if there is
+*       one) is the input, and the output must match test.1 (no file means
+*       no output). Tests run with every instruction checked, and a test
+*       that faults fails with the fault described on stderr. It prints
+*       PASS or FAIL for each test, in order. The second form loads one
+*       program, forks it for each input file, and writes each run's
+*       output to the input's name with .out added.
+*
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "um_machine.h"
+#include "um_pool.h"
+
+#define UM_EXTENSION ".um"
+
+/*
+*       Description: One job: the program (NULL when every job forks the
+*       batch's program), the input file (NULL for none), and the file the
+*       output is compared against or written to. When the job is done,
+*       passed says whether it passed, error (if not NULL) why it couldn't
+*       run, and fault what it faulted on (a test's kind is UM_FAULT_NONE
+*       if it didn't).
+*/
+struct job {
+        const char *name;
+        char *program;
+        char *input;
+        char *output;
+        bool passed;
+        const char *error;
+        Um_fault fault;
+};
+
+/*
+*       Description: The jobs and, for the second form, the loaded program
+*       every job forks, with the lock that keeps forks one at a time.
+*/
+struct batch {
+        struct job *jobs;
+        um_machine base;
+        pthread_mutex_t fork_lock;
+};
+
+/*
+*       Description: Reads a whole file into memory.
+*
+*       In/Out Expectations: Expects a path and a place to store the
+*       length. Returns the bytes, to be freed by the caller, or NULL if
+*       the file can't be read.
+*/
+static unsigned char *read_file(const char *path, size_t *length)
+{
+        FILE *fp = fopen(path, "rb");
+        if (fp == NULL) {
+                return NULL;
+        }
+        size_t capacity = 4096;
+        size_t used = 0;
+        unsigned char *bytes = malloc(capacity);
+        size_t got;
+        while (bytes != NULL &&
+               (got = fread(bytes + used, 1, capacity - used, fp)) > 0) {
+                used += got;
+                if (used == capacity) {
+                        capacity *= 2;
+                        unsigned char *bigger = realloc(bytes, capacity);
+                        if (bigger == NULL) {
+                                free(bytes);
+                        }
+                        bytes = bigger;
+                }
+        }
+        if (ferror(fp)) {
+                free(bytes);
+                bytes = NULL;
+        }
+        fclose(fp);
+        *length = used;
+        return bytes;
+}
+
+/*
+*       Description: Makes a path from a base and a suffix.
+*
+*       In/Out Expectations: Expects the first length characters of base
+*       and a suffix. Returns the new string, to be freed by the caller.
+*/
+static char *make_path(const char *base, size_t length, const char *suffix)
+{
+        char *path = malloc(length + strlen(suffix) + 1);
+        if (path == NULL) {
+                fprintf(stderr, "Error: out of memory.\n");
+                exit(EXIT_FAILURE);
+        }
+        memcpy(path, base, length);
+        strcpy(path + length, suffix);
+        return path;
+}
+
+/*
+*       Description: Checks a job's output against its expected file, or
+*       writes it there when the batch forks one program.
+*
+*       In/Out Expectations: Expects the batch, a job, and its output.
+*       Returns true if the output matched (or was written).
+*/
+static bool finish_output(struct batch *batch, struct job *job,
+                          const unsigned char *output, size_t length)
+{
+        if (batch->base != NULL) {
+                FILE *fp = fopen(job->output, "wb");
+                bool ok = fp != NULL &&
+                          fwrite(output, 1, length, fp) == length;
+                if (fp != NULL && fclose(fp) != 0) {
+                        ok = false;
+                }
+                if (!ok) {
+                        job->error = "its output can't be written";
+                }
+                return ok;
+        }
+
+        size_t expected_length = 0;
+        unsigned char *expected = NULL;
+        if (access(job->output, F_OK) == 0) {
+                expected = read_file(job->output, &expected_length);
+                if (expected == NULL) {
+                        job->error = "its expected output can't be read";
+                        return false;
+                }
+        }
+        bool same = expected_length == length &&
+                    (length == 0 || memcmp(expected, output, length) == 0);
+        free(expected);
+        return same;
+}
+
+/*
+*       Description: Runs one job, as a pool task.
+*
+*       In/Out Expectations: Expects the batch and a job index. Sets the
+*       job's passed and error. Returns nothing.
+*/
+static void run_job(void *cl, size_t index)
+{
+        struct batch *batch = cl;
+        struct job *job = &batch->jobs[index];
+
+        um_machine m;
+        if (batch->base != NULL) {
+                pthread_mutex_lock(&batch->fork_lock);
+                m = um_machine_fork(batch->base);
+                pthread_mutex_unlock(&batch->fork_lock);
+        } else {
+                m = um_machine_new(job->program);
+                if (m == NULL) {
+                        job->error = "the program can't be loaded";
+                        return;
+                }
+        }
+
+        size_t input_length = 0;
+        unsigned char *input = NULL;
+        if (job->input != NULL) {
+                input = read_file(job->input, &input_length);
+                if (input == NULL) {
+                        job->error = "its input can't be read";
+                        um_machine_free(m);
+                        return;
+                }
+        }
+
+        um_machine_set_input(m, input, input_length);
+        bool faulted = false;
+        if (batch->base == NULL) {
+                faulted = um_machine_run_checked(m, &job->fault) == 
+                          UM_FAULTED;
+        } else {
+                um_machine_run(m);
+        }
+        size_t length;
+        const unsigned char *output = um_machine_output(m, &length);
+        job->passed = finish_output(batch, job, output, length) && 
+                      !faulted;
+        um_machine_free(m);
+        free(input);
+}
+
+/*
+*       Description: Sets up a unit test job for a .um file.
+*
+*       In/Out Expectations: Expects the job and the test's path. Returns
+*       nothing.
+*/
+static void test_job(struct job *job, char *path)
+{
+        size_t length = strlen(path);
+        size_t ext = strlen(UM_EXTENSION);
+        if (length > ext && strcmp(path + length - ext, UM_EXTENSION) == 0) {
+                length -= ext;
+        }
+        job->name = path;
+        job->program = path;
+        job->input = make_path(path, length, ".0");
+        job->output = make_path(path, length, ".1");
+        if (access(job->input, F_OK) != 0) {
+                free(job->input);
+                job->input = NULL;
+        }
+}
+
+/*
+*       Description: Parses the options, runs every job, and reports how
+*       each did.
+*
+*       In/Out Expectations: Expects the options in the usage lines above.
+*       Returns exit failure on bad arguments, if the program to fork can't
+*       be loaded, or if any job failed; otherwise exit success.
+*/
+int main(int argc, char *argv[])
+{
+        int threads = 0;
+        const char *program = NULL;
+
+        int opt;
+        bool usage = false;
+        while ((opt = getopt(argc, argv, "j:p:")) != -1) {
+                if (opt == 'j' && atoi(optarg) > 0) {
+                        threads = atoi(optarg);
+                } else if (opt == 'p') {
+                        program = optarg;
+                } else {
+                        usage = true;
+                }
+        }
+        size_t count = argc - optind;
+        if (usage || count == 0) {
+                fprintf(stderr, "Usage: %s [-j threads] test.um ...\n"
+                        "       %s [-j threads] -p program.um input ...\n",
+                        argv[0], argv[0]);
+                return EXIT_FAILURE;
+        }
+
+        struct batch batch;
+        batch.base = NULL;
+        if (program != NULL) {
+                batch.base = um_machine_new(program);
+                if (batch.base == NULL) {
+                        fprintf(stderr, "Error: %s can't be loaded.\n",
+                                program);
+                        return EXIT_FAILURE;
+                }
+        }
+        pthread_mutex_init(&batch.fork_lock, NULL);
+        batch.jobs = calloc(count, sizeof(struct job));
+        if (batch.jobs == NULL) {
+                fprintf(stderr, "Error: out of memory.\n");
+                return EXIT_FAILURE;
+        }
+        for (size_t i = 0; i < count; i++) {
+                char *arg = argv[optind + i];
+                struct job *job = &batch.jobs[i];
+                if (program != NULL) {
+                        job->name = arg;
+                        job->input = arg;
+                        job->output = make_path(arg, strlen(arg), ".out");
+                } else {
+                        test_job(job, arg);
+                }
+        }
+
+        pool_run(count, threads, run_job, &batch);
+
+        size_t passed = 0;
+        for (size_t i = 0; i < count; i++) {
+                struct job *job = &batch.jobs[i];
+                if (job->error != NULL) {
+                        fprintf(stderr, "Error: %s: %s.\n", job->name,
+                                job->error);
+                } else if (program == NULL) {
+                        printf("%s %s\n", job->passed ? "PASS" : "FAIL",
+                               job->name);
+                        if (job->fault.kind != UM_FAULT_NONE) {
+                                fflush(stdout);
+                                fprintf(stderr, "%s: ", job->name);
+                                report_fault(&job->fault, stderr);
+                        }
+                }
+                passed += job->passed;
+                if (program == NULL) {
+                        free(job->input);
+                }
+                free(job->output);
+        }
+        if (program == NULL) {
+                printf("%zu of %zu tests passed\n", passed, count);
+        } else {
+                um_machine_free(batch.base);
+        }
+        pthread_mutex_destroy(&batch.fork_lock);
+        free(batch.jobs);
+
+        return passed == count ? EXIT_SUCCESS : EXIT_FAILURE;
+}
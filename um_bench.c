@@ -0,0 +1,353 @@
+/******************************************************************************
+*       um_bench.c
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the benchmark driver behind make bench. It runs
+*       each program from umbin a number of times under a um binary, checks
+*       every run's output against the expected file, and prints one JSON
+*       object per benchmark with the median and minimum wall time,
+*       instructions per second, and peak resident set size. Only correct
+*       runs are timed; with none, the times are null.
+*
+*       Usage: um_bench [-n runs] [-u um] [-d umbin] [-l label]
+*                       [benchmark ...]
+*
+*       A label (such as the build configuration the um was built with) is
+*       added to every JSON object as "config".
+*
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#define DEFAULT_RUNS 5
+#define MAX_RUNS 100
+#define PATH_LENGTH 1024
+
+/*
+*       Description: One benchmark: the program to run, the file fed to its
+*       standard input (NULL for none), and the file its output must match.
+*       All paths are relative to the umbin directory.
+*/
+struct benchmark {
+        const char *name;
+        const char *program;
+        const char *input;
+        const char *expected;
+};
+
+static const struct benchmark benchmarks[] = {
+        { "hello",    "hello.um",     NULL,           "hello.out" },
+        { "cat",      "cat.um",       "sandmark.out", "sandmark.out" },
+        { "midmark",  "midmark.um",   NULL,           "midmark.out" },
+        { "sandmark", "sandmark.umz", NULL,           "sandmark.out" },
+};
+
+#define NUM_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+/*
+*       Description: The measurements from a single run.
+*/
+struct run {
+        double seconds;
+        long max_rss_kb;
+        bool correct;
+};
+
+/*
+*       Description: Runs the um once on a benchmark with extra arguments
+*       (e.g. a profiling flag) placed before the program name.
+*
+*       In/Out Expectations: Expects the um binary, the umbin directory, a
+*       benchmark, an optional extra argument pair (NULL for none), and the
+*       file the output is written to. Returns false if the um couldn't be
+*       started or didn't exit successfully; otherwise fills in the run's
+*       time and peak RSS (correct is left to the caller).
+*/
+static bool run_once(const char *um, const char *dir,
+                     const struct benchmark *b, const char *flag,
+                     const char *flag_arg, const char *out_path,
+                     struct run *result)
+{
+        char program[PATH_LENGTH];
+        char input[PATH_LENGTH];
+        snprintf(program, sizeof(program), "%s/%s", dir, b->program);
+        if (b->input != NULL) {
+                snprintf(input, sizeof(input), "%s/%s", dir, b->input);
+        } else {
+                snprintf(input, sizeof(input), "/dev/null");
+        }
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        pid_t pid = fork();
+        if (pid < 0) {
+                return false;
+        }
+        if (pid == 0) {
+                int in = open(input, O_RDONLY);
+                int out = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (in < 0 || out < 0) {
+                        _exit(127);
+                }
+                dup2(in, STDIN_FILENO);
+                dup2(out, STDOUT_FILENO);
+                if (flag != NULL) {
+                        execl(um, um, flag, flag_arg, program, (char *)NULL);
+                } else {
+                        execl(um, um, program, (char *)NULL);
+                }
+                _exit(127);
+        }
+
+        int status;
+        struct rusage usage;
+        if (wait4(pid, &status, 0, &usage) != pid) {
+                return false;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        result->seconds = (end.tv_sec - start.tv_sec) +
+                          (end.tv_nsec - start.tv_nsec) / 1e9;
+        result->max_rss_kb = usage.ru_maxrss;
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/*
+*       Description: Compares two files byte for byte.
+*
+*       In/Out Expectations: Expects two paths. Returns true if both can be
+*       opened and hold the same bytes.
+*/
+static bool same_file(const char *path1, const char *path2)
+{
+        FILE *f1 = fopen(path1, "rb");
+        FILE *f2 = fopen(path2, "rb");
+        bool same = (f1 != NULL && f2 != NULL);
+
+        while (same) {
+                int c1 = getc(f1);
+                int c2 = getc(f2);
+                if (c1 != c2) {
+                        same = false;
+                } else if (c1 == EOF) {
+                        break;
+                }
+        }
+
+        if (f1 != NULL) {
+                fclose(f1);
+        }
+        if (f2 != NULL) {
+                fclose(f2);
+        }
+        return same;
+}
+
+/*
+*       Description: Counts the instructions a benchmark executes, by
+*       running it once with um --profile-json.
+*
+*       In/Out Expectations: Expects the um binary, the umbin directory, a
+*       benchmark, and scratch file paths for the output and the profile.
+*       Returns the instruction count, or 0 if it couldn't be found.
+*/
+static uint64_t count_instructions(const char *um, const char *dir,
+                                   const struct benchmark *b,
+                                   const char *out_path,
+                                   const char *json_path)
+{
+        struct run result;
+        if (!run_once(um, dir, b, "--profile-json", json_path, out_path,
+                      &result)) {
+                return 0;
+        }
+
+        FILE *fp = fopen(json_path, "r");
+        if (fp == NULL) {
+                return 0;
+        }
+        uint64_t count = 0;
+        if (fscanf(fp, " { \"instructions\": %" SCNu64, &count) != 1) {
+                count = 0;
+        }
+        fclose(fp);
+        return count;
+}
+
+/*
+*       Description: Orders doubles from smallest to largest, for qsort.
+*/
+static int compare_doubles(const void *a, const void *b)
+{
+        double x = *(const double *)a;
+        double y = *(const double *)b;
+        return (x > y) - (x < y);
+}
+
+/*
+*       Description: Runs a benchmark the given number of times and prints
+*       its JSON line to stdout.
+*
+*       In/Out Expectations: Expects the um binary, the umbin directory, a
+*       benchmark, a number of runs between 1 and MAX_RUNS, and a label
+*       (NULL for none). Returns true if every run succeeded and produced
+*       the expected output.
+*/
+static bool run_benchmark(const char *um, const char *dir,
+                          const struct benchmark *b, int runs,
+                          const char *label)
+{
+        char out_path[] = "/tmp/um_bench_out.XXXXXX";
+        char json_path[] = "/tmp/um_bench_json.XXXXXX";
+        int out_fd = mkstemp(out_path);
+        int json_fd = mkstemp(json_path);
+        if (out_fd < 0 || json_fd < 0) {
+                fprintf(stderr, "Error: can't create temporary files.\n");
+                exit(EXIT_FAILURE);
+        }
+        close(out_fd);
+        close(json_fd);
+
+        char expected[PATH_LENGTH];
+        snprintf(expected, sizeof(expected), "%s/%s", dir, b->expected);
+
+        double seconds[MAX_RUNS];
+        long max_rss_kb = 0;
+        int correct = 0;
+        for (int i = 0; i < runs; i++) {
+                struct run result;
+                result.correct = run_once(um, dir, b, NULL, NULL, out_path,
+                                          &result) &&
+                                 same_file(out_path, expected);
+                if (!result.correct) {
+                        continue;
+                }
+                /* only correct runs count towards the timing */
+                seconds[correct++] = result.seconds;
+                if (result.max_rss_kb > max_rss_kb) {
+                        max_rss_kb = result.max_rss_kb;
+                }
+        }
+        uint64_t instructions = count_instructions(um, dir, b, out_path,
+                                                   json_path);
+        unlink(out_path);
+        unlink(json_path);
+
+        printf("{");
+        if (label != NULL) {
+                printf("\"config\": \"%s\", ", label);
+        }
+        printf("\"benchmark\": \"%s\", \"runs\": %d, \"correct\": %d, ",
+               b->name, runs, correct);
+        if (correct > 0) {
+                qsort(seconds, correct, sizeof(seconds[0]), compare_doubles);
+                double median = (correct % 2 == 1) ? seconds[correct / 2] :
+                                (seconds[correct / 2 - 1] +
+                                 seconds[correct / 2]) / 2;
+                printf("\"median_seconds\": %.4f, \"min_seconds\": %.4f, "
+                       "\"instructions\": %" PRIu64 ", "
+                       "\"instructions_per_second\": %.0f, ", median,
+                       seconds[0], instructions,
+                       median > 0 ? instructions / median : 0.0);
+        } else {
+                /* no correct run to time */
+                printf("\"median_seconds\": null, \"min_seconds\": null, "
+                       "\"instructions\": %" PRIu64 ", "
+                       "\"instructions_per_second\": null, ",
+                       instructions);
+        }
+        printf("\"max_rss_kb\": %ld}\n", max_rss_kb);
+        fflush(stdout);
+
+        if (correct != runs) {
+                fprintf(stderr, "Error: %s produced the wrong output "
+                        "(%d of %d runs correct).\n", b->name, correct, runs);
+        }
+        return correct == runs;
+}
+
+/*
+*       Description: Parses the options, runs the chosen benchmarks (all of
+*       them if none are named), and prints one JSON line each.
+*
+*       In/Out Expectations: Expects the options in the usage line above.
+*       Returns exit failure on bad arguments or if any benchmark gave the
+*       wrong output, otherwise exit success.
+*/
+int main(int argc, char *argv[])
+{
+        const char *um = "./um";
+        const char *dir = "umbin";
+        const char *label = NULL;
+        int runs = DEFAULT_RUNS;
+
+        int opt;
+        while ((opt = getopt(argc, argv, "n:u:d:l:")) != -1) {
+                switch (opt) {
+                case 'n':
+                        runs = atoi(optarg);
+                        break;
+                case 'u':
+                        um = optarg;
+                        break;
+                case 'd':
+                        dir = optarg;
+                        break;
+                case 'l':
+                        label = optarg;
+                        break;
+                default:
+                        runs = 0;
+                        break;
+                }
+        }
+        if (runs < 1 || runs > MAX_RUNS) {
+                fprintf(stderr, "Usage: %s [-n runs (1-%d)] [-u um] "
+                        "[-d umbin] [-l label] [benchmark ...]\n", argv[0],
+                        MAX_RUNS);
+                return EXIT_FAILURE;
+        }
+
+        for (int j = optind; j < argc; j++) {
+                bool known = false;
+                for (size_t i = 0; i < NUM_BENCHMARKS; i++) {
+                        known = known ||
+                                strcmp(argv[j], benchmarks[i].name) == 0;
+                }
+                if (!known) {
+                        fprintf(stderr, "Error: no benchmark named %s.\n",
+                                argv[j]);
+                        return EXIT_FAILURE;
+                }
+        }
+
+        bool ok = true;
+        for (size_t i = 0; i < NUM_BENCHMARKS; i++) {
+                bool chosen = (optind == argc);
+                for (int j = optind; j < argc; j++) {
+                        if (strcmp(argv[j], benchmarks[i].name) == 0) {
+                                chosen = true;
+                        }
+                }
+                if (chosen) {
+                        ok = run_benchmark(um, dir, &benchmarks[i], runs,
+                                           label) && ok;
+                }
+        }
+
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
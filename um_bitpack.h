@@ -0,0 +1,82 @@
+/******************************************************************************
+*       um_bitpack.h
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains header-only versions of the unsigned Bitpack
+*       functions the um uses to pick apart and build instruction words.
+*       They behave exactly like Bitpack_getu, Bitpack_newu and
+*       Bitpack_fitsu from bitpack_copy.c (checked by bitpack_test),
+*       including widths and shifts of 64, but are static inline so the
+*       compiler can fold them into plain shifts and masks, and the um
+*       needs no Comp40 library.
+*
+******************************************************************************/
+
+#ifndef UM_BITPACK_
+#define UM_BITPACK_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+
+/*
+*       Description: Shifts left or right by 0 to 64 bits; C leaves a shift
+*       by 64 undefined, and x86 hardware would make it a shift by 0.
+*/
+static inline uint64_t um_shl(uint64_t word, unsigned bits)
+{
+        return bits >= 64 ? 0 : word << bits;
+}
+
+static inline uint64_t um_shr(uint64_t word, unsigned bits)
+{
+        return bits >= 64 ? 0 : word >> bits;
+}
+
+/*
+*       Description: Checks whether an unsigned value fits in a width.
+*
+*       In/Out Expectations: Expects a value and a width. Returns true if
+*       the value can be stored in width bits.
+*/
+static inline bool um_fitsu(uint64_t n, unsigned width)
+{
+        return width >= 64 || um_shr(n, width) == 0;
+}
+
+/*
+*       Description: Gets an unsigned field from a word.
+*
+*       In/Out Expectations: Expects a word, the field's width, and its
+*       least significant bit, with width + lsb at most 64. Returns the
+*       field's value.
+*/
+static inline uint64_t um_getu(uint64_t word, unsigned width, unsigned lsb)
+{
+        unsigned hi = lsb + width;
+        assert(hi <= 64);
+        return um_shr(um_shl(word, 64 - hi), 64 - width);
+}
+
+/*
+*       Description: Replaces an unsigned field in a word.
+*
+*       In/Out Expectations: Expects a word, the field's width and least
+*       significant bit (width + lsb at most 64), and a value that fits in
+*       the width. Returns the word with the field set to the value.
+*/
+static inline uint64_t um_newu(uint64_t word, unsigned width, unsigned lsb,
+                               uint64_t value)
+{
+        unsigned hi = lsb + width;
+        assert(hi <= 64);
+        assert(um_fitsu(value, width));
+        return um_shl(um_shr(word, hi), hi) |
+               um_shr(um_shl(word, 64 - lsb), 64 - lsb) |
+               um_shl(value, lsb);
+}
+
+#endif
@@ -0,0 +1,594 @@
+/******************************************************************************
+*       um_cfg.c
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the implementation of the control flow analysis.
+*       Block leaders are pc 0, the word after each halt, load program or
+*       invalid word, and every constant jump target. Constants are only
+*       followed within a block, from its start, so a register is known
+*       there only if it is held at 0 (below). Finding a target makes a new
+*       leader, which can split the block that found it, so the leaders
+*       are grown until a pass over the program adds none. Loops are the
+*       strongly connected components of the known edges, so a call (a
+*       constant jump whose return is computed) is not mistaken for one.
+*
+*       Compiled programs keep a register at 0 for the whole run (the
+*       segment register of their jumps), so a block does not start with
+*       every register unknown: a register that no block reachable from
+*       pc 0 writes (counting only blocks that go on to another block) is
+*       taken to hold its starting 0 everywhere. Dropping a register from
+*       that set can lose jumps and with them reachable blocks, so it is
+*       shrunk until the blocks it finds agree with it.
+*
+*       Two things are assumed, so the result is for reports, not for
+*       running the program: a load program whose target isn't a constant
+*       (a return, a jump table) lands on the start of a block, and code
+*       reached only that way doesn't write the registers held at 0.
+*
+******************************************************************************/
+
+#include <stdlib.h>
+#include <assert.h>
+#include <inttypes.h>
+#include "um_cfg.h"
+#include "um_decode.h"
+
+/*
+*       Description: What the analysis knows about a register: count is 0
+*       if it could hold anything, else it holds one of the count values.
+*/
+struct value {
+        uint8_t count;
+        uint32_t v[2];
+};
+
+/*
+*       Description: The blocks in program order, and for every pc of
+*       segment 0 the index of the block holding it.
+*/
+struct cfg {
+        uint32_t length;
+        uint32_t num_blocks;
+        Cfg_block *blocks;
+        uint32_t *block_of;
+        uint8_t zeros;
+};
+
+static const struct value unknown = { 0, { 0, 0 } };
+
+/*
+*       Description: Makes a value that is known to be one constant.
+*
+*       In/Out Expectations: Expects the constant. Returns the value.
+*/
+static struct value constant(uint32_t v)
+{
+        struct value val = { 1, { v, 0 } };
+        return val;
+}
+
+/*
+*       Description: Merges what two registers could hold, for a
+*       conditional move whose condition isn't known.
+*
+*       In/Out Expectations: Expects two values. Returns a value holding
+*       either one's constants, or unknown if there are more than two or
+*       either is unknown.
+*/
+static struct value join(struct value x, struct value y)
+{
+        if (x.count == 0 || y.count == 0) {
+                return unknown;
+        }
+        for (int i = 0; i < y.count; i++) {
+                if (x.count == 1 && x.v[0] != y.v[i]) {
+                        x.v[x.count++] = y.v[i];
+                } else if (x.v[0] != y.v[i] && x.v[1] != y.v[i]) {
+                        return unknown;
+                }
+        }
+        return x;
+}
+
+/*
+*       Description: Applies one non-terminating instruction to what is
+*       known about the registers.
+*
+*       In/Out Expectations: Expects the registers' values and an
+*       instruction word that isn't a halt, load program or invalid word.
+*       Returns nothing.
+*/
+static void step(struct value *regs, uint32_t word)
+{
+        Um_decoded ins = decode_instruction(word);
+        struct value b = regs[ins.rb];
+        struct value c = regs[ins.rc];
+        bool both = b.count == 1 && c.count == 1;
+
+        switch (ins.opcode) {
+        case CMOV:
+                if (c.count == 0 || (c.count == 2 &&
+                    (c.v[0] == 0) != (c.v[1] == 0))) {
+                        regs[ins.ra] = join(regs[ins.ra], b);
+                } else if (c.v[0] != 0) {
+                        regs[ins.ra] = b;
+                }
+                break;
+        case ADD:
+                regs[ins.ra] = both ? constant(b.v[0] + c.v[0]) : unknown;
+                break;
+        case MUL:
+                regs[ins.ra] = both ? constant(b.v[0] * c.v[0]) : unknown;
+                break;
+        case DIV:
+                regs[ins.ra] = both && c.v[0] != 0 ?
+                               constant(b.v[0] / c.v[0]) : unknown;
+                break;
+        case NAND:
+                regs[ins.ra] = both ? constant(~(b.v[0] & c.v[0])) :
+                               unknown;
+                break;
+        case SLOAD:
+                regs[ins.ra] = unknown;
+                break;
+        case MAP:
+                regs[ins.rb] = unknown;
+                break;
+        case IN:
+                regs[ins.rc] = unknown;
+                break;
+        case LOADV:
+                regs[ins.ra] = constant(ins.value);
+                break;
+        default:
+                break;
+        }
+}
+
+/*
+*       Description: Finds the register an instruction writes.
+*
+*       In/Out Expectations: Expects an instruction word. Returns the
+*       register's number, or -1 if it writes none.
+*/
+static int written_register(uint32_t word)
+{
+        Um_decoded ins = decode_instruction(word);
+        switch (ins.opcode) {
+        case CMOV: case SLOAD: case ADD: case MUL: case DIV: case NAND:
+        case LOADV:
+                return ins.ra;
+        case MAP:
+                return ins.rb;
+        case IN:
+                return ins.rc;
+        default:
+                return -1;
+        }
+}
+
+/*
+*       Description: Follows one block from its leader: finds where it
+*       ends, how, and any constant jump targets.
+*
+*       In/Out Expectations: Expects segment 0's words and length, the
+*       leader flags, the registers held at 0 (bit i for register i), the
+*       block's first pc, and a block to fill. Returns nothing.
+*/
+static void scan_block(const uint32_t *words, uint32_t length,
+                       const bool *leader, uint8_t zeros, uint32_t start,
+                       Cfg_block *block)
+{
+        struct value regs[8];
+        for (int i = 0; i < 8; i++) {
+                regs[i] = (zeros >> i) & 1 ? constant(0) : unknown;
+        }
+        block->start = start;
+        block->exit = CFG_FALLTHROUGH;
+        block->targets[0] = CFG_NO_TARGET;
+        block->targets[1] = CFG_NO_TARGET;
+        block->entries = 0;
+        block->loop = CFG_NO_TARGET;
+
+        uint32_t pc = start;
+        for (;;) {
+                uint32_t word = words[pc++];
+                uint32_t opcode = word >> 28;
+                if (opcode == HALT) {
+                        block->exit = CFG_HALT;
+                        break;
+                } else if (opcode > LOADV) {
+                        block->exit = CFG_INVALID;
+                        break;
+                } else if (opcode == LOADP) {
+                        Um_decoded ins = decode_instruction(word);
+                        struct value seg = regs[ins.rb];
+                        struct value target = regs[ins.rc];
+                        if (seg.count != 1) {
+                                block->exit = CFG_COMPUTED;
+                        } else if (seg.v[0] != 0) {
+                                block->exit = CFG_LOAD_PROGRAM;
+                        } else if (target.count == 0) {
+                                block->exit = CFG_COMPUTED;
+                        } else {
+                                block->exit = CFG_JUMP;
+                                for (int i = 0; i < target.count; i++) {
+                                        block->targets[i] = target.v[i];
+                                }
+                        }
+                        break;
+                }
+                step(regs, word);
+                if (pc == length || leader[pc]) {
+                        break;
+                }
+        }
+        block->end = pc;
+}
+
+/*
+*       Description: Splits a program into blocks, given the registers held
+*       at 0, and counts the known entries into each.
+*
+*       In/Out Expectations: Expects a cfg with its length set and its
+*       blocks not yet made, and segment 0's words. Returns nothing.
+*/
+static void find_blocks(cfg graph, const uint32_t *words)
+{
+        uint32_t length = graph->length;
+        bool *leader = calloc((size_t)length + 1, sizeof(bool));
+        assert(leader != NULL);
+        leader[0] = true;
+
+        bool changed = true;
+        while (changed) {
+                changed = false;
+                for (uint32_t pc = 0; pc < length; ) {
+                        Cfg_block block;
+                        scan_block(words, length, leader, graph->zeros, pc,
+                                   &block);
+                        leader[block.end] = true;
+                        for (int i = 0; i < 2; i++) {
+                                uint32_t t = block.targets[i];
+                                if (t < length && !leader[t]) {
+                                        leader[t] = true;
+                                        changed = true;
+                                }
+                        }
+                        pc = block.end;
+                }
+        }
+
+        graph->num_blocks = 0;
+        for (uint32_t pc = 0; pc < length; pc++) {
+                graph->num_blocks += leader[pc];
+        }
+        graph->blocks = malloc(((size_t)graph->num_blocks + 1) *
+                               sizeof(Cfg_block));
+        graph->block_of = malloc(((size_t)length + 1) * sizeof(uint32_t));
+        assert(graph->blocks != NULL && graph->block_of != NULL);
+
+        uint32_t index = 0;
+        for (uint32_t pc = 0; pc < length; index++) {
+                Cfg_block *block = &graph->blocks[index];
+                scan_block(words, length, leader, graph->zeros, pc, block);
+                for (; pc < block->end; pc++) {
+                        graph->block_of[pc] = index;
+                }
+        }
+        free(leader);
+
+        if (length > 0) {
+                graph->blocks[0].entries = 1;
+        }
+        for (uint32_t i = 0; i < graph->num_blocks; i++) {
+                Cfg_block *block = &graph->blocks[i];
+                if (block->exit == CFG_FALLTHROUGH && block->end < length) {
+                        graph->blocks[i + 1].entries++;
+                }
+                for (int t = 0; t < 2; t++) {
+                        if (block->targets[t] < length) {
+                                uint32_t to =
+                                        graph->block_of[block->targets[t]];
+                                graph->blocks[to].entries++;
+                        }
+                }
+        }
+}
+
+/*
+*       Description: Gives one of a block's known successors: 0 is the
+*       block it falls through to, 1 and 2 its jump targets.
+*
+*       In/Out Expectations: Expects a cfg with its blocks made, a block
+*       index and a successor number. Returns the successor's index, or
+*       CFG_NO_TARGET if there is no such successor.
+*/
+static uint32_t successor(cfg graph, uint32_t i, int n)
+{
+        const Cfg_block *block = &graph->blocks[i];
+        if (n == 0) {
+                return block->exit == CFG_FALLTHROUGH &&
+                       block->end < graph->length ? i + 1 : CFG_NO_TARGET;
+        }
+        return cfg_block_at(graph, block->targets[n - 1]);
+}
+
+/*
+*       Description: Marks the blocks that are in loops, with Tarjan's
+*       strongly connected components algorithm (run with an explicit
+*       stack, since programs have thousands of blocks).
+*
+*       In/Out Expectations: Expects a cfg with its blocks made. Sets each
+*       block's loop. Returns nothing.
+*/
+static void find_loops(cfg graph)
+{
+        uint32_t n = graph->num_blocks;
+        uint32_t *order = malloc(((size_t)n + 1) * sizeof(uint32_t));
+        uint32_t *low = malloc(((size_t)n + 1) * sizeof(uint32_t));
+        uint32_t *component = malloc(((size_t)n + 1) * sizeof(uint32_t));
+        uint32_t *calls = malloc(((size_t)n + 1) * sizeof(uint32_t));
+        uint8_t *next = malloc((size_t)n + 1);
+        bool *on_stack = calloc((size_t)n + 1, sizeof(bool));
+        assert(order != NULL && low != NULL && component != NULL &&
+               calls != NULL && next != NULL && on_stack != NULL);
+        for (uint32_t i = 0; i < n; i++) {
+                order[i] = CFG_NO_TARGET;
+        }
+
+        uint32_t visited = 0, members = 0;
+        for (uint32_t root = 0; root < n; root++) {
+                if (order[root] != CFG_NO_TARGET) {
+                        continue;
+                }
+                uint32_t depth = 0;
+                calls[depth++] = root;
+                order[root] = low[root] = visited++;
+                next[root] = 0;
+                component[members++] = root;
+                on_stack[root] = true;
+                while (depth > 0) {
+                        uint32_t v = calls[depth - 1];
+                        if (next[v] < 3) {
+                                uint32_t w = successor(graph, v, next[v]++);
+                                if (w == CFG_NO_TARGET) {
+                                        continue;
+                                } else if (order[w] == CFG_NO_TARGET) {
+                                        order[w] = low[w] = visited++;
+                                        next[w] = 0;
+                                        component[members++] = w;
+                                        on_stack[w] = true;
+                                        calls[depth++] = w;
+                                } else if (on_stack[w] && order[w] < low[v]) {
+                                        low[v] = order[w];
+                                }
+                                continue;
+                        }
+                        depth--;
+                        if (depth > 0 && low[v] < low[calls[depth - 1]]) {
+                                low[calls[depth - 1]] = low[v];
+                        }
+                        if (low[v] != order[v]) {
+                                continue;
+                        }
+                        uint32_t first = members;
+                        do {
+                                first--;
+                                on_stack[component[first]] = false;
+                        } while (component[first] != v);
+                        bool cyclic = members - first > 1;
+                        for (int s = 0; s < 3; s++) {
+                                cyclic = cyclic || successor(graph, v, s) == v;
+                        }
+                        uint32_t head = v;
+                        for (uint32_t m = first; m < members; m++) {
+                                if (component[m] < head) {
+                                        head = component[m];
+                                }
+                        }
+                        for (uint32_t m = first; cyclic && m < members; m++) {
+                                graph->blocks[component[m]].loop = head;
+                        }
+                        members = first;
+                }
+        }
+        free(order);
+        free(low);
+        free(component);
+        free(calls);
+        free(next);
+        free(on_stack);
+}
+
+/*
+*       Description: Finds the registers written by the blocks reachable
+*       from pc 0 by fall throughs and constant jumps. Blocks that halt or
+*       end in an invalid word are left out, since nothing runs after
+*       their writes.
+*
+*       In/Out Expectations: Expects a cfg with its blocks made and segment
+*       0's words. Returns the registers, bit i for register i.
+*/
+static uint8_t reachable_writes(cfg graph, const uint32_t *words)
+{
+        uint32_t num_blocks = graph->num_blocks;
+        bool *seen = calloc((size_t)num_blocks + 1, sizeof(bool));
+        uint32_t *work = malloc(((size_t)num_blocks + 1) * sizeof(uint32_t));
+        assert(seen != NULL && work != NULL);
+
+        uint8_t written = 0;
+        uint32_t pending = 0;
+        if (num_blocks > 0) {
+                seen[0] = true;
+                work[pending++] = 0;
+        }
+        while (pending > 0) {
+                uint32_t i = work[--pending];
+                const Cfg_block *block = &graph->blocks[i];
+                if (block->exit == CFG_HALT || block->exit == CFG_INVALID) {
+                        continue;
+                }
+                for (uint32_t pc = block->start; pc < block->end; pc++) {
+                        int reg = written_register(words[pc]);
+                        if (reg >= 0) {
+                                written |= 1 << reg;
+                        }
+                }
+                for (int n = 0; n < 3; n++) {
+                        uint32_t next = successor(graph, i, n);
+                        if (next != CFG_NO_TARGET && !seen[next]) {
+                                seen[next] = true;
+                                work[pending++] = next;
+                        }
+                }
+        }
+        free(seen);
+        free(work);
+        return written;
+}
+
+/*
+*       Description: Analyzes a program that starts at pc 0 with every
+*       register 0.
+*
+*       In/Out Expectations: Expects segment 0's words and their number
+*       (which may be 0). Returns its cfg, to be freed with free_cfg.
+*/
+cfg new_cfg(const uint32_t *words, uint32_t length)
+{
+        cfg graph = malloc(sizeof(*graph));
+        assert(graph != NULL);
+        graph->length = length;
+        graph->zeros = 0xff;
+        for (;;) {
+                find_blocks(graph, words);
+                uint8_t written = reachable_writes(graph, words);
+                if ((graph->zeros & written) == 0) {
+                        find_loops(graph);
+                        return graph;
+                }
+                graph->zeros &= ~written;
+                free(graph->blocks);
+                free(graph->block_of);
+        }
+}
+
+/*
+*       Description: Frees a cfg.
+*
+*       In/Out Expectations: Expects a cfg from new_cfg. Returns nothing.
+*/
+void free_cfg(cfg graph)
+{
+        free(graph->blocks);
+        free(graph->block_of);
+        free(graph);
+}
+
+/*
+*       Description: Gives the number of basic blocks.
+*
+*       In/Out Expectations: Expects a valid cfg. Returns the number.
+*/
+uint32_t cfg_blocks(cfg graph)
+{
+        return graph->num_blocks;
+}
+
+/*
+*       Description: Gives one basic block; blocks are numbered in program
+*       order from 0.
+*
+*       In/Out Expectations: Expects a valid cfg and an index below
+*       cfg_blocks. Returns the block, which lives as long as the cfg.
+*/
+const Cfg_block *cfg_block(cfg graph, uint32_t index)
+{
+        assert(index < graph->num_blocks);
+        return &graph->blocks[index];
+}
+
+/*
+*       Description: Finds the block holding a pc.
+*
+*       In/Out Expectations: Expects a valid cfg and a pc. Returns the
+*       block's index, or CFG_NO_TARGET if the pc is past the program.
+*/
+uint32_t cfg_block_at(cfg graph, uint32_t pc)
+{
+        return pc < graph->length ? graph->block_of[pc] : CFG_NO_TARGET;
+}
+
+/*
+*       Description: Writes a summary line and then one line per basic
+*       block.
+*
+*       In/Out Expectations: Expects a valid cfg and an open stream.
+*       Returns nothing.
+*/
+void cfg_print(cfg graph, FILE *out)
+{
+        uint32_t exits[CFG_INVALID + 1] = { 0 };
+        uint32_t conditional = 0, loops = 0;
+        for (uint32_t i = 0; i < graph->num_blocks; i++) {
+                const Cfg_block *block = &graph->blocks[i];
+                exits[block->exit]++;
+                conditional += block->targets[1] != CFG_NO_TARGET;
+                loops += block->loop == i;
+        }
+        fprintf(out, "segment 0: %" PRIu32 " words, %" PRIu32 " blocks, "
+                "%" PRIu32 " constant jumps (%" PRIu32 " conditional), "
+                "%" PRIu32 " computed jumps, %" PRIu32 " program loads, "
+                "%" PRIu32 " loops\n", graph->length, graph->num_blocks,
+                exits[CFG_JUMP], conditional, exits[CFG_COMPUTED],
+                exits[CFG_LOAD_PROGRAM], loops);
+        fprintf(out, "registers held at 0:");
+        for (int i = 0; i < 8; i++) {
+                if ((graph->zeros >> i) & 1) {
+                        fprintf(out, " r%d", i);
+                }
+        }
+        fprintf(out, "\n");
+
+        for (uint32_t i = 0; i < graph->num_blocks; i++) {
+                const Cfg_block *block = &graph->blocks[i];
+                fprintf(out, "block %" PRIu32 ": pc %" PRIu32 "-%" PRIu32
+                        ", %" PRIu32 " instructions, %" PRIu32
+                        " known entries, ", i, block->start, block->end - 1,
+                        block->end - block->start, block->entries);
+                switch (block->exit) {
+                case CFG_FALLTHROUGH:
+                        fprintf(out, block->end < graph->length ?
+                                "falls through" : "runs off the end");
+                        break;
+                case CFG_JUMP:
+                        fprintf(out, "jumps to %" PRIu32, block->targets[0]);
+                        if (block->targets[1] != CFG_NO_TARGET) {
+                                fprintf(out, " or %" PRIu32,
+                                        block->targets[1]);
+                        }
+                        break;
+                case CFG_COMPUTED:
+                        fprintf(out, "computed jump");
+                        break;
+                case CFG_LOAD_PROGRAM:
+                        fprintf(out, "loads a program");
+                        break;
+                case CFG_HALT:
+                        fprintf(out, "halts");
+                        break;
+                case CFG_INVALID:
+                        fprintf(out, "invalid instruction");
+                        break;
+                }
+                if (block->loop != CFG_NO_TARGET) {
+                        fprintf(out, " (loop at pc %" PRIu32 ")",
+                                graph->blocks[block->loop].start);
+                }
+                fprintf(out, "\n");
+        }
+}
@@ -0,0 +1,74 @@
+/******************************************************************************
+*       um_cfg.h
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the declarations for the static control flow
+*       analysis of a loaded program. It splits segment 0 into basic blocks
+*       and finds the load programs whose jump targets are constants (a
+*       load value into the target register earlier in the block, maybe
+*       picked between two by a conditional move), without running the
+*       program. um --cfg prints it; the profiler uses it to turn its
+*       per-pc counts into block entry counts and hot loops.
+*
+******************************************************************************/
+
+#ifndef UM_CFG_
+#define UM_CFG_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CFG_NO_TARGET UINT32_MAX
+
+/*
+*       Description: How a basic block ends.
+*
+*           CFG_FALLTHROUGH   the next instruction starts another block (or
+*                             the block runs off the end of segment 0)
+*           CFG_JUMP          load program from segment 0 to one or two
+*                             constant targets
+*           CFG_COMPUTED      load program whose target (or segment) isn't
+*                             known, such as a return
+*           CFG_LOAD_PROGRAM  load program from a constant nonzero segment,
+*                             which replaces the program
+*           CFG_HALT          halt
+*           CFG_INVALID       an opcode 14 or 15 word
+*/
+typedef enum Cfg_exit {
+        CFG_FALLTHROUGH, CFG_JUMP, CFG_COMPUTED, CFG_LOAD_PROGRAM, CFG_HALT,
+        CFG_INVALID
+} Cfg_exit;
+
+/*
+*       Description: One basic block: the instructions from start up to,
+*       not including, end. targets holds a jump's targets, the second
+*       CFG_NO_TARGET unless a conditional move picks between two, and
+*       entries counts the known edges into the block (fall throughs and
+*       constant jumps; pc 0 counts as one). A block with none is only
+*       entered by a computed jump, or is data. loop is the index of the
+*       first block of the loop the block is in (a cycle of known edges;
+*       nested loops count as one), or CFG_NO_TARGET.
+*/
+typedef struct Cfg_block {
+        uint32_t start;
+        uint32_t end;
+        Cfg_exit exit;
+        uint32_t targets[2];
+        uint32_t entries;
+        uint32_t loop;
+} Cfg_block;
+
+typedef struct cfg *cfg;
+
+cfg new_cfg(const uint32_t *words, uint32_t length);
+void free_cfg(cfg graph);
+uint32_t cfg_blocks(cfg graph);
+const Cfg_block *cfg_block(cfg graph, uint32_t index);
+uint32_t cfg_block_at(cfg graph, uint32_t pc);
+void cfg_print(cfg graph, FILE *out);
+
+#endif
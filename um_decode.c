@@ -0,0 +1,125 @@
+/******************************************************************************
+*       um_decode.c
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the functions that unpack a whole segment of 
+*       instruction words into their pre-decoded form, fusing common pairs
+*       into superinstructions, and keep that form up to date as words
+*       change.
+*   
+******************************************************************************/
+
+#include "um_decode.h"
+
+/*
+*       Description: Fuses an instruction with the one after it, if they 
+*       make up one of the superinstruction pairs in um_decode.h.
+*
+*       In/Out Expectations: Expects the plain decodings of two adjacent
+*       instructions. Returns the fused instruction, or first unchanged.
+*/
+static Um_decoded fuse(Um_decoded first, Um_decoded second)
+{
+        uint8_t opcode;
+        if (first.opcode == LOADV && second.opcode == ADD) {
+                opcode = LOADV_ADD;
+        } else if (first.opcode == LOADV && second.opcode == LOADP) {
+                opcode = LOADV_LOADP;
+        } else if (first.opcode == NAND && second.opcode == NAND) {
+                opcode = NAND_NAND;
+        } else if (first.opcode == CMOV && second.opcode == LOADP) {
+                opcode = CMOV_LOADP;
+        } else {
+                return first;
+        }
+
+        Um_decoded fused;
+        fused.opcode = opcode;
+        fused.ra = first.ra | second.ra << 3;
+        fused.rb = first.rb | second.rb << 3;
+        fused.rc = first.rc | second.rc << 3;
+        fused.value = first.value;
+        return fused;
+}
+
+/*
+*       Description: Decodes the instruction at one index of a segment, 
+*       fused with the next one where they pair up.
+*
+*       In/Out Expectations: Expects an array of length words and an index
+*       into it. Returns the decoded instruction.
+*/
+static Um_decoded decode_at(const uint32_t *words, uint32_t length, 
+                            uint32_t index)
+{
+        Um_decoded ins = decode_instruction(words[index]);
+        if (index + 1 < length) {
+                ins = fuse(ins, decode_instruction(words[index + 1]));
+        }
+        return ins;
+}
+
+/*
+*       Description: Decodes every word of a segment.
+*
+*       In/Out Expectations: Expects an array of length instruction words 
+*       and an array with room for length decoded instructions. Fills the
+*       second array, returns nothing.
+*/
+void decode_segment(const uint32_t *words, Um_decoded *decoded, 
+                    uint32_t length)
+{
+        for (uint32_t i = 0; i < length; i++) {
+                decoded[i] = decode_at(words, length, i);
+        }
+}
+
+/*
+*       Description: Brings a decoded segment up to date after one of its
+*       words changed: the word's own decoding, and the one before it in 
+*       case that was fused with it.
+*
+*       In/Out Expectations: Expects the segment's words (already holding 
+*       the new word), its decoded array, its length, and the index of the
+*       changed word. Returns nothing.
+*/
+void patch_decoded(const uint32_t *words, Um_decoded *decoded, 
+                   uint32_t length, uint32_t index)
+{
+        decoded[index] = decode_at(words, length, index);
+        if (index > 0) {
+                decoded[index - 1] = decode_at(words, length, index - 1);
+        }
+}
+
+/*
+*       Description: Splits a superinstruction opcode into the opcodes of
+*       the pair it stands for.
+*
+*       In/Out Expectations: Expects an opcode of at least UM_FUSED_FIRST.
+*       Sets first and second, returns nothing.
+*/
+void fused_parts(uint32_t opcode, uint32_t *first, uint32_t *second)
+{
+        switch (opcode) {
+        case LOADV_ADD:
+                *first = LOADV;
+                *second = ADD;
+                break;
+        case LOADV_LOADP:
+                *first = LOADV;
+                *second = LOADP;
+                break;
+        case NAND_NAND:
+                *first = NAND;
+                *second = NAND;
+                break;
+        default:
+                *first = CMOV;
+                *second = LOADP;
+                break;
+        }
+}
@@ -0,0 +1,88 @@
+/******************************************************************************
+*       um_decode.h
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the pre-decoded form of a um instruction and the
+*       functions that unpack 32 bit instruction words into it. Segment 0 is
+*       kept in this form alongside its raw words so that the instruction
+*       loop does not pay to extract the same fields every time it runs an
+*       instruction.
+*   
+******************************************************************************/
+
+#ifndef UM_DECODE_
+#define UM_DECODE_
+
+#include <stdint.h>
+
+/*
+*       Description: One unpacked instruction. For three register 
+*       instructions ra, rb and rc hold the register numbers and value is 0.
+*       For load value, ra holds the register to load and value holds the
+*       25 bit immediate.
+*/
+typedef struct Um_decoded {
+        uint8_t opcode;
+        uint8_t ra;
+        uint8_t rb;
+        uint8_t rc;
+        uint32_t value;
+} Um_decoded;
+
+/*
+*       Opcodes from 16 up are superinstructions: decode_segment fuses some
+*       common pairs of instructions into one decoded instruction, so the 
+*       loop dispatches once for both. The second instruction keeps its 
+*       own decoding at the next index, for jumps that land on it. In a 
+*       fused pair, bits 0-2 of ra, rb and rc are the first instruction's
+*       registers and bits 3-5 the second's; a first load value keeps its
+*       register in ra and its immediate in value.
+*
+*           LOADV_ADD    load value x, v; add a, b, c
+*           LOADV_LOADP  load value x, v; load program b, c
+*           NAND_NAND    nand a1, b1, c1; nand a2, b2, c2
+*           CMOV_LOADP   conditional move a, b, c; load program b2, c2
+*/
+typedef enum Um_opcode {
+        CMOV = 0, SLOAD, SSTORE, ADD, MUL, DIV,
+        NAND, HALT, MAP, UNMAP, OUT, IN, LOADP, LOADV,
+        LOADV_ADD = 16, LOADV_LOADP, NAND_NAND, CMOV_LOADP, UM_OPCODES
+} Um_opcode;
+
+#define UM_FUSED_FIRST LOADV_ADD
+
+/*
+*       Description: Unpacks one instruction word.
+*
+*       In/Out Expectations: Expects any 32 bit word. Returns its fields as
+*       an Um_decoded; words with opcodes 14 and 15 keep their opcode so the
+*       instruction loop can still reject them.
+*/
+static inline Um_decoded decode_instruction(uint32_t word)
+{
+        Um_decoded ins;
+        ins.opcode = word >> 28;
+        if (ins.opcode == LOADV) {
+                ins.ra = (word >> 25) & 0x7;
+                ins.rb = 0;
+                ins.rc = 0;
+                ins.value = word & 0x1ffffff;
+        } else {
+                ins.ra = (word >> 6) & 0x7;
+                ins.rb = (word >> 3) & 0x7;
+                ins.rc = word & 0x7;
+                ins.value = 0;
+        }
+        return ins;
+}
+
+void decode_segment(const uint32_t *words, Um_decoded *decoded, 
+                    uint32_t length);
+void patch_decoded(const uint32_t *words, Um_decoded *decoded, 
+                   uint32_t length, uint32_t index);
+void fused_parts(uint32_t opcode, uint32_t *first, uint32_t *second);
+
+#endif
@@ -0,0 +1,512 @@
+/******************************************************************************
+*       um_diff.c
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the differential runner, which runs the fast
+*       instruction loop (execute_budgeted) and the reference loop
+*       (execute_reference_budgeted) side by side on the same program and
+*       input. Every N instructions it compares their pcs, registers,
+*       output and memory. When they differ, it runs both again from the
+*       start to the last point where they agreed and steps them one
+*       instruction at a time from there, so it can report the first
+*       instruction whose effect differs. With -j, the jit
+*       (execute_jit_budgeted, compiling every block the first time it is
+*       entered) takes the fast loop's place; its blocks can't be stepped,
+*       so it halves the interval they first differ in instead, down to
+*       one instruction. Built and run on the umbin and um-lab programs,
+*       both ways, by make diff.
+*
+*       Usage: um_diff [-j] [-n N] program.um ...
+*
+*       A program's input is the file with the same name ending in .0 (as
+*       in um-lab), or nothing if there is none. N is the number of
+*       instructions between comparisons (100000 by default); neither loop
+*       checks for faults, so a divergence that makes one crash before the
+*       next comparison crashes um_diff, and a smaller N is needed to find
+*       it.
+*
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include "memory_type.h"
+#include "um_populate.h"
+#include "um_operations.h"
+#include "um_io.h"
+#include "um_jit.h"
+
+#define DEFAULT_INTERVAL 100000
+
+static const char *const names[] = {
+        "CMOV", "SLOAD", "SSTORE", "ADD", "MUL", "DIV", "NAND", "HALT",
+        "MAP", "UNMAP", "OUT", "IN", "LOADP", "LOADV", "opcode 14",
+        "opcode 15"
+};
+
+/*
+*       Description: One of the two runs: its memory, registers, pc, io,
+*       whether it has halted, and its jit (NULL but for a -j fast run).
+*/
+struct run {
+        memory mem;
+        jit j;
+        uint32_t r[8];
+        uint32_t pc;
+        io_buffer io;
+        bool halted;
+};
+
+/*
+*       Description: A program being compared: its file name, its input,
+*       the two runs, how much of their output has been compared, and
+*       whether the fast run uses the jit (and what to call it).
+*/
+struct program {
+        const char *filename;
+        unsigned char *input;
+        size_t input_length;
+        struct run fast;
+        struct run reference;
+        size_t output_checked;
+        bool use_jit;
+        const char *fast_name;
+};
+
+/*
+*       Description: Reads a whole file.
+*
+*       In/Out Expectations: Expects a path and a place to store the
+*       length. Returns the bytes, to be freed, or NULL if the file can't
+*       be opened.
+*/
+static unsigned char *read_file(const char *path, size_t *length)
+{
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL) {
+                return NULL;
+        }
+        size_t capacity = 4096;
+        unsigned char *bytes = malloc(capacity);
+        *length = 0;
+        size_t got;
+        while ((got = fread(bytes + *length, 1, capacity - *length, fp))
+               > 0) {
+                *length += got;
+                if (*length == capacity) {
+                        capacity *= 2;
+                        bytes = realloc(bytes, capacity);
+                }
+        }
+        fclose(fp);
+        return bytes;
+}
+
+/*
+*       Description: Reads a program's input: the file named like it with
+*       the extension replaced by .0.
+*
+*       In/Out Expectations: Expects the program's file name and a place to
+*       store the length. Returns the input, to be freed, or NULL (with
+*       length 0) if there is none.
+*/
+static unsigned char *read_input(const char *filename, size_t *length)
+{
+        size_t stem = strlen(filename);
+        const char *dot = strrchr(filename, '.');
+        if (dot != NULL && strchr(dot, '/') == NULL) {
+                stem = dot - filename;
+        }
+        char *path = malloc(stem + 3);
+        memcpy(path, filename, stem);
+        strcpy(path + stem, ".0");
+        unsigned char *input = read_file(path, length);
+        if (input == NULL) {
+                *length = 0;
+        }
+        free(path);
+        return input;
+}
+
+/*
+*       Description: Starts (or restarts) a run of the program from its
+*       first instruction, with all of its input.
+*
+*       In/Out Expectations: Expects the program and one of its runs.
+*       Returns false if the program can't be read or isn't a whole number
+*       of 32 bit words; a run that couldn't be opened is left with NULL
+*       memory and io, which end_run skips.
+*/
+static bool start_run(struct program *p, struct run *run)
+{
+        run->mem = NULL;
+        run->j = NULL;
+        run->io = NULL;
+        FILE *fp = fopen(p->filename, "r");
+        if (fp == NULL) {
+                return false;
+        }
+        run->mem = new_memory();
+        bool ok = populate_instructions(fp, run->mem);
+        fclose(fp);
+        memset(run->r, 0, sizeof(run->r));
+        run->pc = 0;
+        run->io = new_io_bytes(p->input, p->input_length, true);
+        run->halted = false;
+        if (ok && p->use_jit && run == &p->fast) {
+                run->j = new_jit(run->mem, 1, true);
+        }
+        return ok;
+}
+
+/*
+*       Description: Frees what a run started with start_run holds.
+*
+*       In/Out Expectations: Expects a run that start_run was called on,
+*       whether or not it succeeded. Returns nothing.
+*/
+static void end_run(struct run *run)
+{
+        if (run->j != NULL) {
+                free_jit(run->j);
+                run->j = NULL;
+        }
+        if (run->io != NULL) {
+                free_io(run->io);
+                run->io = NULL;
+        }
+        if (run->mem != NULL) {
+                free_memory(run->mem);
+                run->mem = NULL;
+        }
+}
+
+/*
+*       Description: Runs the fast loop (or the jit) for a number of
+*       instructions, then the reference loop for as many as it ran.
+*
+*       In/Out Expectations: Expects the program and a budget of at least 1
+*       for runs that haven't halted. Returns the number of instructions
+*       run, which is the budget unless the program halted.
+*/
+static uint64_t run_both(struct program *p, uint64_t budget)
+{
+        uint64_t left = budget;
+        Um_status status;
+        if (p->use_jit) {
+                status = execute_jit_budgeted(p->fast.mem, p->fast.r,
+                                              &p->fast.pc, p->fast.io,
+                                              p->fast.j, &left);
+        } else {
+                status = execute_budgeted(p->fast.mem, p->fast.r,
+                                          &p->fast.pc, p->fast.io, &left);
+        }
+        p->fast.halted = (status == UM_HALTED);
+        uint64_t ran = budget - left;
+        left = ran;
+        status = execute_reference_budgeted(p->reference.mem,
+                                            p->reference.r,
+                                            &p->reference.pc,
+                                            p->reference.io, &left);
+        p->reference.halted = (status == UM_HALTED);
+        return ran;
+}
+
+/*
+*       Description: Compares the two runs and describes the first thing
+*       that differs.
+*
+*       In/Out Expectations: Expects the program, whether to compare
+*       memory as well, and a buffer for the description. Returns true if
+*       they are the same; otherwise false, with the description in why.
+*/
+static bool same(struct program *p, bool check_memory, char *why,
+                 size_t size)
+{
+        struct run *f = &p->fast;
+        struct run *ref = &p->reference;
+        if (f->halted != ref->halted) {
+                snprintf(why, size, "the %s halted and the %s didn't",
+                         f->halted ? p->fast_name : "reference loop",
+                         f->halted ? "reference loop" : p->fast_name);
+                return false;
+        }
+        if (!f->halted && f->pc != ref->pc) {
+                snprintf(why, size, "the next pc is %" PRIu32 " in the %s, "
+                         "%" PRIu32 " in the reference loop", f->pc,
+                         p->fast_name, ref->pc);
+                return false;
+        }
+        for (int i = 0; i < 8; i++) {
+                if (f->r[i] != ref->r[i]) {
+                        snprintf(why, size, "r%d is 0x%08" PRIx32 " in the "
+                                 "%s, 0x%08" PRIx32 " in the reference "
+                                 "loop", i, f->r[i], p->fast_name,
+                                 ref->r[i]);
+                        return false;
+                }
+        }
+
+        size_t fast_length, ref_length;
+        const unsigned char *fast_out = io_output(f->io, &fast_length);
+        const unsigned char *ref_out = io_output(ref->io, &ref_length);
+        size_t length = fast_length < ref_length ? fast_length : ref_length;
+        for (size_t i = p->output_checked; i < length; i++) {
+                if (fast_out[i] != ref_out[i]) {
+                        snprintf(why, size, "output byte %zu is 0x%02x in "
+                                 "the %s, 0x%02x in the reference loop", i,
+                                 fast_out[i], p->fast_name, ref_out[i]);
+                        return false;
+                }
+        }
+        p->output_checked = length;
+        if (fast_length != ref_length) {
+                snprintf(why, size, "the %s has output %zu bytes, the "
+                         "reference loop %zu", p->fast_name, fast_length,
+                         ref_length);
+                return false;
+        }
+
+        uint32_t seg, index;
+        if (check_memory && !memory_equal(f->mem, ref->mem, &seg, &index)) {
+                if (index == UINT32_MAX) {
+                        snprintf(why, size, "segment %" PRIu32 " is mapped "
+                                 "differently", seg);
+                } else {
+                        snprintf(why, size, "word %" PRIu32 " of segment %"
+                                 PRIu32 " is 0x%08" PRIx32 " in the %s, "
+                                 "0x%08" PRIx32 " in the reference loop",
+                                 index, seg, get_memory(f->mem, seg, index),
+                                 p->fast_name,
+                                 get_memory(ref->mem, seg, index));
+                }
+                return false;
+        }
+        return true;
+}
+
+/*
+*       Description: Checks whether an instruction can change memory other
+*       than through registers, so stepping need only compare memory after
+*       those.
+*/
+static bool touches_memory(uint32_t opcode)
+{
+        return opcode == SSTORE || opcode == MAP || opcode == UNMAP ||
+               opcode == LOADP;
+}
+
+/*
+*       Description: Runs both runs again from the start, for a number of
+*       intervals and then some more instructions.
+*
+*       In/Out Expectations: Expects the program, the interval, the number
+*       of intervals, the number of instructions after them, and a place
+*       to store the number of instructions run. Returns false, with an
+*       error on stderr, if the program can't be read again.
+*/
+static bool replay(struct program *p, uint64_t interval, uint64_t agreed,
+                   uint64_t extra, uint64_t *count)
+{
+        end_run(&p->fast);
+        end_run(&p->reference);
+        bool ok = start_run(p, &p->fast);
+        ok = start_run(p, &p->reference) && ok;
+        p->output_checked = 0;
+        if (!ok) {
+                fprintf(stderr, "Error: %s can't be read again to find "
+                        "where the loops diverge.\n", p->filename);
+                return false;
+        }
+
+        *count = 0;
+        for (uint64_t i = 0; i < agreed; i++) {
+                *count += run_both(p, interval);
+        }
+        if (extra > 0 && !p->fast.halted) {
+                *count += run_both(p, extra);
+        }
+        return true;
+}
+
+/*
+*       Description: Finds the first instruction at which the runs differ,
+*       by running both again to the last point they agreed and stepping
+*       from there, and reports it.
+*
+*       In/Out Expectations: Expects the program, the interval, and the
+*       number of intervals the runs agreed for. Returns nothing.
+*/
+static void find_divergence(struct program *p, uint64_t interval,
+                            uint64_t agreed)
+{
+        char why[256];
+        uint64_t count;
+        if (!replay(p, interval, agreed, 0, &count)) {
+                return;
+        }
+        for (uint64_t i = 0; i < interval && !p->fast.halted; i++) {
+                uint32_t pc = p->reference.pc;
+                uint32_t word = get_memory(p->reference.mem, 0, pc);
+                count += run_both(p, 1);
+                if (!same(p, touches_memory(get_code(word)), why,
+                          sizeof(why))) {
+                        printf("%s: the loops diverge at instruction %"
+                               PRIu64 " (pc %" PRIu32 ", %s, instruction "
+                               "0x%08" PRIx32 "): %s.\n", p->filename,
+                               count, pc, names[get_code(word)], word, why);
+                        return;
+                }
+        }
+        printf("%s: the loops differ after %" PRIu64 " instructions, but "
+               "not when stepped.\n", p->filename, count);
+}
+
+/*
+*       Description: Finds where the jit and the reference loop diverge.
+*       The jit can't be stepped (a block only runs when the whole of it
+*       fits in the budget), so this halves the interval they first
+*       differed in, running both again from the start to its middle each
+*       time, and reports the last instruction of the shortest run after
+*       which they differ.
+*
+*       In/Out Expectations: Expects the program, the interval, and the
+*       number of intervals the runs agreed for. Returns nothing.
+*/
+static void find_jit_divergence(struct program *p, uint64_t interval,
+                                uint64_t agreed)
+{
+        char why[256];
+        uint64_t count;
+        uint64_t agree = 0;
+        uint64_t differ = interval;
+        while (differ - agree > 1) {
+                uint64_t middle = agree + (differ - agree) / 2;
+                if (!replay(p, interval, agreed, middle, &count)) {
+                        return;
+                }
+                if (same(p, true, why, sizeof(why))) {
+                        agree = middle;
+                } else {
+                        differ = middle;
+                }
+        }
+
+        if (!replay(p, interval, agreed, agree, &count)) {
+                return;
+        }
+        uint32_t pc = p->reference.pc;
+        uint32_t word = get_memory(p->reference.mem, 0, pc);
+        if (!replay(p, interval, agreed, differ, &count)) {
+                return;
+        }
+        if (same(p, true, why, sizeof(why))) {
+                printf("%s: the jit and the reference loop differ after %"
+                       PRIu64 " instructions, but not when run again.\n",
+                       p->filename, count);
+                return;
+        }
+        printf("%s: the jit and the reference loop diverge by instruction %"
+               PRIu64 " (pc %" PRIu32 ", %s, instruction 0x%08" PRIx32
+               "; the jit runs blocks whole, so it may be an earlier "
+               "instruction of its block): %s.\n", p->filename, count, pc,
+               names[get_code(word)], word, why);
+}
+
+/*
+*       Description: Runs a program under both loops and reports whether
+*       they agree.
+*
+*       In/Out Expectations: Expects the program's file name, the number
+*       of instructions between comparisons, and whether to run the jit in
+*       place of the fast loop. Returns true if they agree to the end of
+*       the program.
+*/
+static bool diff_program(const char *filename, uint64_t interval,
+                         bool use_jit)
+{
+        struct program p;
+        p.filename = filename;
+        p.use_jit = use_jit;
+        p.fast_name = use_jit ? "jit" : "fast loop";
+        p.input = read_input(filename, &p.input_length);
+        p.output_checked = 0;
+        bool ok = start_run(&p, &p.fast);
+        ok = start_run(&p, &p.reference) && ok;
+        if (!ok) {
+                fprintf(stderr, "Error: %s can't be read, or its size is "
+                        "not a multiple of 4 bytes.\n", filename);
+                end_run(&p.fast);
+                end_run(&p.reference);
+                free(p.input);
+                return false;
+        }
+
+        char why[256];
+        uint64_t count = 0;
+        uint64_t agreed = 0;
+        for (;;) {
+                count += run_both(&p, interval);
+                if (!same(&p, true, why, sizeof(why))) {
+                        if (use_jit) {
+                                find_jit_divergence(&p, interval, agreed);
+                        } else {
+                                find_divergence(&p, interval, agreed);
+                        }
+                        ok = false;
+                        break;
+                }
+                agreed++;
+                if (p.fast.halted) {
+                        printf("%s: %" PRIu64 " instructions, no "
+                               "divergence.\n", filename, count);
+                        break;
+                }
+        }
+
+        end_run(&p.fast);
+        end_run(&p.reference);
+        free(p.input);
+        return ok;
+}
+
+/*
+*       Description: Compares the loops on every program given.
+*
+*       In/Out Expectations: Expects the usage above. Returns exit failure
+*       if any program can't be read or the loops diverge on it.
+*/
+int main(int argc, char *argv[])
+{
+        uint64_t interval = DEFAULT_INTERVAL;
+        bool use_jit = false;
+        int opt;
+        while ((opt = getopt(argc, argv, "jn:")) != -1) {
+                if (opt == 'j') {
+                        use_jit = true;
+                } else if (opt == 'n' && strtoull(optarg, NULL, 10) > 0) {
+                        interval = strtoull(optarg, NULL, 10);
+                } else {
+                        optind = argc + 1;
+                        break;
+                }
+        }
+        if (optind >= argc) {
+                fprintf(stderr, "Usage: %s [-j] [-n N] program.um ...\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+        }
+
+        bool ok = true;
+        for (int i = optind; i < argc; i++) {
+                ok = diff_program(argv[i], interval, use_jit) && ok;
+        }
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
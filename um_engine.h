@@ -0,0 +1,461 @@
+/******************************************************************************
+*       um_engine.h
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the body of the fast instruction loop. It has no
+*       include guard: um_operations.c includes it once per variant of the
+*       loop it needs, after defining
+*
+*           ENGINE_NAME     the name of the static function to define
+*           ENGINE_PROFILE  1 to feed a profile from every instruction
+*           ENGINE_JIT      1 to hand the jit every pc where a block may
+*                           start (the program start, and after each 
+*                           instruction the jit doesn't translate or 
+*                           exits on)
+*           ENGINE_SUSPEND  1 to stop before the first input instruction,
+*                           leaving it to be run after a restore
+*           ENGINE_BUDGET   1 to stop before the instruction that would
+*                           run past an instruction budget, or an input
+*                           instruction whose input isn't there yet
+*                           (with ENGINE_JIT, the jit's blocks count
+*                           against the budget too)
+*           ENGINE_CHECKED  1 to check every instruction for a um fault 
+*                           (see Um_fault) before running it, and stop 
+*                           there with a description of it instead of 
+*                           running on or aborting
+*           ENGINE_TRACE    1 to hand a trace every instruction's effects
+*                           (a fused pair's halves one at a time), and 
+*                           stop if it says to
+*
+*       so each variant is compiled separately and the plain loop carries 
+*       no trace of the others. The fetch, decode and dispatch macros it 
+*       uses (PROGRAM, FETCH, OPCODE, RA, ..., OP, NEXT) are defined in 
+*       um_operations.c.
+*   
+******************************************************************************/
+
+#ifndef ENGINE_NAME
+#error "define ENGINE_NAME before including um_engine.h"
+#endif
+#ifndef ENGINE_PROFILE
+#define ENGINE_PROFILE 0
+#endif
+#ifndef ENGINE_JIT
+#define ENGINE_JIT 0
+#endif
+#ifndef ENGINE_SUSPEND
+#define ENGINE_SUSPEND 0
+#endif
+#ifndef ENGINE_BUDGET
+#define ENGINE_BUDGET 0
+#endif
+#ifndef ENGINE_CHECKED
+#define ENGINE_CHECKED 0
+#endif
+#ifndef ENGINE_TRACE
+#define ENGINE_TRACE 0
+#endif
+
+/* 
+ * The number of um instructions an instruction fetch stands for. A fused
+ * pair that doesn't fit in what is left of a budget is split: its first
+ * instruction is decoded again from its word and run alone, so a budget
+ * is always used exactly (the second keeps its own decoding).
+ */
+#if UM_FUSED
+#define ENGINE_COST(ins) (1 + (OPCODE(ins) >= UM_FUSED_FIRST))
+#define ENGINE_SPLIT()  do { half = decode_instruction(                 \
+                                     get_segment(mem, 0)[pc - 1]);      \
+                             ins = &half; } while (0)
+#else
+#define ENGINE_COST(ins) 1
+#define ENGINE_SPLIT()  ((void)0)
+#endif
+
+#if ENGINE_PROFILE
+#define ENGINE_STEP()   profile_step(prof, OPCODE(ins), pc - 1)
+#define ENGINE_HOOK(x)  x
+#elif ENGINE_BUDGET
+#define ENGINE_STEP()   do { if (left == 0) {                           \
+                                     pc--;                              \
+                                     goto suspend;                      \
+                             }                                          \
+                             if (left < ENGINE_COST(ins)) {             \
+                                     ENGINE_SPLIT();                    \
+                             }                                          \
+                             left -= ENGINE_COST(ins); } while (0)
+#define ENGINE_HOOK(x)
+#else
+#define ENGINE_STEP()   ((void)0)
+#define ENGINE_HOOK(x)
+#endif
+
+#if ENGINE_JIT && ENGINE_BUDGET
+#define ENGINE_JIT_BUDGET (&left)
+#else
+#define ENGINE_JIT_BUDGET NULL
+#endif
+
+#if ENGINE_JIT
+/* blocks may store to segment 0 and copy its words, so fetch it again */
+#define ENGINE_ENTER()  do { pc = jit_run(j, reg, pc, ENGINE_JIT_BUDGET); \
+                             program = PROGRAM(mem); } while (0)
+#define JIT_HOOK(x)     x
+#else
+#define ENGINE_ENTER()  ((void)0)
+#define JIT_HOOK(x)
+#endif
+
+#if ENGINE_SUSPEND
+#define SUSPEND_HOOK(x) x
+#else
+#define SUSPEND_HOOK(x)
+#endif
+
+#if ENGINE_BUDGET
+#define BUDGET_HOOK(x)  x
+#else
+#define BUDGET_HOOK(x)
+#endif
+
+#if ENGINE_TRACE
+#define TRACE_HOOK(call) do { if (!(call)) goto suspend; } while (0)
+#else
+#define TRACE_HOOK(call) ((void)0)
+#endif
+
+/* A register write by the instruction at pc at */
+#define TRACE_REG(opcode, a, at) TRACE_HOOK(trace_reg(tr, (at), (opcode), \
+                                                      (a), reg[(a)]))
+
+/* 
+ * Fault checks, for the instruction at pc at. Everywhere but the checked
+ * variant they compile to nothing: a faulting program is undefined there.
+ */
+#if ENGINE_CHECKED
+#define ENGINE_CHECK(ok, fault_kind, at) do {                           \
+                if (!(ok)) {                                            \
+                        fault->kind = (fault_kind);                     \
+                        fault->pc = (at);                               \
+                        goto faulted;                                   \
+                }                                                       \
+        } while (0)
+#else
+#define ENGINE_CHECK(ok, fault_kind, at) ((void)0)
+#endif
+
+/* The word at index in segment seg must be mapped */
+#define ENGINE_CHECK_WORD(seg, index, at) do {                          \
+                ENGINE_CHECK(segment_mapped(mem, (seg)),                \
+                             UM_FAULT_BAD_SEGMENT, (at));               \
+                ENGINE_CHECK((index) < segment_length(mem, (seg)),      \
+                             UM_FAULT_OUT_OF_BOUNDS, (at));             \
+        } while (0)
+
+/* Run before each fetch: the pc must be inside segment 0 */
+#define ENGINE_GUARD()  ENGINE_CHECK(pc < segment_length(mem, 0),       \
+                                     UM_FAULT_BAD_PC, pc)
+
+/* 
+ * Load program from the registers numbered b and c, for the instruction
+ * at pc at. The target and segment are read first: ins may point into the
+ * segment 0 being replaced.
+ */
+#define ENGINE_LOADP(b, c, at) do {                                     \
+                uint32_t seg_ = reg[(b)];                               \
+                ENGINE_CHECK(segment_mapped(mem, seg_),                 \
+                             UM_FAULT_BAD_SEGMENT, (at));               \
+                TRACE_HOOK(trace_loadp(tr, (at), seg_));                \
+                pc = reg[(c)];                                          \
+                ENGINE_HOOK(profile_loadp(prof, seg_));                 \
+                if (seg_ != 0) {                                        \
+                        duplicate_instructions(mem, seg_);              \
+                        program = PROGRAM(mem);                         \
+                        JIT_HOOK(jit_reset(j);)                         \
+                }                                                       \
+                ENGINE_ENTER();                                         \
+        } while (0)
+
+#if UM_THREADED
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+/*
+*       Description: Gets instructions from memory, and iterates 
+*       through/performs all instructions. Registers and the program 
+*       counter are kept in locals, segment 0 is fetched through a cached
+*       pointer, and each handler decodes only the fields it uses.
+*
+*       In/Out Expectations: Expects a valid memory type, a pointer
+*       to the array of registers, a pointer to the pc to start at, the 
+*       io_buffer to do input and output through, the profile to record 
+*       into (for a profiling variant), the jit to run blocks with (for
+*       a jit variant), the number of instructions it may run (for a
+*       budgeted variant, which leaves the number not used there), the
+*       fault to fill in (for a checked variant), and the trace to feed 
+*       (for a tracing variant). Expects that the first segment in memory
+*       is populated with the program. Copies the final register values 
+*       back into r and flushes output when it stops. Returns false on 
+*       halt; a suspending or budgeted variant returns true when it stops
+*       at an input instruction or the end of its budget (with none left,
+*       unless it stopped for input), a checked one when it stops at a 
+*       fault, and a tracing one when the trace stops it, with *start set 
+*       to the pc to resume at (the faulting instruction's).
+*/
+static bool ENGINE_NAME(memory mem, uint32_t *r, uint32_t *start, 
+                        io_buffer io, profile prof, jit j, uint64_t *budget,
+                        Um_fault *fault, trace tr)
+{
+        uint32_t reg[8];
+        for (int i = 0; i < 8; i++) {
+                reg[i] = r[i];
+        }
+        Um_program program = PROGRAM(mem);
+        uint32_t pc = *start;
+        Um_fetched ins;
+        (void)prof;
+        (void)j;
+        (void)budget;
+        (void)fault;
+        (void)tr;
+#if ENGINE_BUDGET
+        uint64_t left = *budget;
+#if UM_FUSED
+        Um_decoded half;
+#endif
+#endif
+        ENGINE_ENTER();
+
+#if UM_THREADED
+        static void *const dispatch_table[UM_OPCODES] = {
+                &&op_CMOV, &&op_SLOAD, &&op_SSTORE, &&op_ADD, &&op_MUL,
+                &&op_DIV, &&op_NAND, &&op_HALT, &&op_MAP, &&op_UNMAP,
+                &&op_OUT, &&op_IN, &&op_LOADP, &&op_LOADV,
+                &&op_INVALID, &&op_INVALID,
+#if UM_FUSED
+                &&op_LOADV_ADD, &&op_LOADV_LOADP, &&op_NAND_NAND,
+                &&op_CMOV_LOADP
+#else
+                &&op_INVALID, &&op_INVALID, &&op_INVALID, &&op_INVALID
+#endif
+        };
+        NEXT;
+#else
+        for (;;) {
+        ENGINE_GUARD();
+        ins = FETCH(program, pc++);
+        ENGINE_STEP();
+        switch (OPCODE(ins)) {
+#endif
+
+        OP(CMOV):
+                if (reg[RC(ins)] != 0) {
+                        reg[RA(ins)] = reg[RB(ins)];
+                }
+                TRACE_REG(CMOV, RA(ins), pc - 1);
+                NEXT;
+
+        OP(SLOAD):
+                ENGINE_CHECK_WORD(reg[RB(ins)], reg[RC(ins)], pc - 1);
+                reg[RA(ins)] = get_memory(mem, reg[RB(ins)], reg[RC(ins)]);
+                TRACE_REG(SLOAD, RA(ins), pc - 1);
+                NEXT;
+
+        OP(SSTORE):
+                ENGINE_CHECK_WORD(reg[RA(ins)], reg[RB(ins)], pc - 1);
+                JIT_HOOK(if (reg[RA(ins)] == 0) {
+                        jit_store(j, reg[RB(ins)]);
+                })
+                if (set_word(mem, reg[RA(ins)], reg[RB(ins)], reg[RC(ins)])) {
+                        /* a shared segment was copied; it may be segment 0 */
+                        program = PROGRAM(mem);
+                }
+                TRACE_HOOK(trace_store(tr, pc - 1, reg[RA(ins)], 
+                                       reg[RB(ins)], reg[RC(ins)]));
+                ENGINE_ENTER();
+                NEXT;
+
+        OP(ADD):
+                reg[RA(ins)] = reg[RB(ins)] + reg[RC(ins)];
+                TRACE_REG(ADD, RA(ins), pc - 1);
+                NEXT;
+
+        OP(MUL):
+                reg[RA(ins)] = reg[RB(ins)] * reg[RC(ins)];
+                TRACE_REG(MUL, RA(ins), pc - 1);
+                NEXT;
+
+        OP(DIV):
+                ENGINE_CHECK(reg[RC(ins)] != 0, UM_FAULT_DIVIDE_BY_ZERO,
+                             pc - 1);
+                reg[RA(ins)] = reg[RB(ins)] / reg[RC(ins)];
+                TRACE_REG(DIV, RA(ins), pc - 1);
+                NEXT;
+
+        OP(NAND):
+                reg[RA(ins)] = ~(reg[RB(ins)] & reg[RC(ins)]);
+                TRACE_REG(NAND, RA(ins), pc - 1);
+                NEXT;
+
+        OP(MAP):
+                ENGINE_HOOK(profile_map(prof));
+                reg[RB(ins)] = new_seg(mem, reg[RC(ins)]);
+                TRACE_HOOK(trace_map(tr, pc - 1, RB(ins), reg[RB(ins)],
+                                     segment_length(mem, reg[RB(ins)])));
+                ENGINE_ENTER();
+                NEXT;
+
+        OP(UNMAP):
+                ENGINE_CHECK(reg[RC(ins)] != 0, UM_FAULT_UNMAP_ZERO, pc - 1);
+                ENGINE_CHECK(segment_mapped(mem, reg[RC(ins)]),
+                             UM_FAULT_BAD_SEGMENT, pc - 1);
+                ENGINE_HOOK(profile_unmap(prof));
+                free_segment(mem, reg[RC(ins)]);
+                TRACE_HOOK(trace_unmap(tr, pc - 1, reg[RC(ins)]));
+                ENGINE_ENTER();
+                NEXT;
+
+        OP(OUT):
+                ENGINE_CHECK(reg[RC(ins)] <= MAX_VAL, UM_FAULT_BAD_OUTPUT,
+                             pc - 1);
+                io_put(io, reg[RC(ins)]);
+                TRACE_HOOK(trace_out(tr, pc - 1, reg[RC(ins)]));
+                ENGINE_ENTER();
+                NEXT;
+
+        OP(IN):
+                SUSPEND_HOOK(pc--; goto suspend;)
+                /* blocked: give back the instruction's budget and wait */
+                BUDGET_HOOK(if (io_blocked(io)) {
+                        pc--;
+                        left++;
+                        goto suspend;
+                })
+                reg[RC(ins)] = io_get(io);
+                TRACE_REG(IN, RC(ins), pc - 1);
+                ENGINE_ENTER();
+                NEXT;
+
+        OP(LOADP):
+                ENGINE_LOADP(RB(ins), RC(ins), pc - 1);
+                NEXT;
+
+        OP(LOADV):
+                reg[RA_LOAD(ins)] = LOAD_VAL(ins);
+                TRACE_REG(LOADV, RA_LOAD(ins), pc - 1);
+                NEXT;
+
+        OP(HALT):
+                TRACE_HOOK(trace_halt(tr, pc - 1));
+                goto halt;
+
+#if UM_FUSED
+        OP(LOADV_ADD):
+                reg[RA1(ins)] = LOAD_VAL(ins);
+                TRACE_REG(LOADV, RA1(ins), pc - 1);
+                reg[RA2(ins)] = reg[RB2(ins)] + reg[RC2(ins)];
+                TRACE_REG(ADD, RA2(ins), pc);
+                pc++;
+                NEXT;
+
+        OP(LOADV_LOADP):
+                reg[RA1(ins)] = LOAD_VAL(ins);
+                TRACE_REG(LOADV, RA1(ins), pc - 1);
+                ENGINE_LOADP(RB2(ins), RC2(ins), pc);
+                NEXT;
+
+        OP(NAND_NAND):
+                reg[RA1(ins)] = ~(reg[RB1(ins)] & reg[RC1(ins)]);
+                TRACE_REG(NAND, RA1(ins), pc - 1);
+                reg[RA2(ins)] = ~(reg[RB2(ins)] & reg[RC2(ins)]);
+                TRACE_REG(NAND, RA2(ins), pc);
+                pc++;
+                NEXT;
+
+        OP(CMOV_LOADP):
+                if (reg[RC1(ins)] != 0) {
+                        reg[RA1(ins)] = reg[RB1(ins)];
+                }
+                TRACE_REG(CMOV, RA1(ins), pc - 1);
+                ENGINE_LOADP(RB2(ins), RC2(ins), pc);
+                NEXT;
+#endif
+
+#if UM_THREADED
+        op_INVALID:
+#else
+        default:
+#endif
+                ENGINE_CHECK(false, UM_FAULT_INVALID_OPCODE, pc - 1);
+                assert(0);
+#if !UM_THREADED
+        }
+        }
+#endif
+
+halt:
+        io_flush(io);
+        for (int i = 0; i < 8; i++) {
+                r[i] = reg[i];
+        }
+#if ENGINE_BUDGET
+        *budget = left;
+#endif
+        return false;
+
+#if ENGINE_SUSPEND || ENGINE_BUDGET || ENGINE_TRACE
+suspend:
+        io_flush(io);
+        for (int i = 0; i < 8; i++) {
+                r[i] = reg[i];
+        }
+#if ENGINE_BUDGET
+        *budget = left;
+#endif
+        *start = pc;
+        return true;
+#endif
+
+#if ENGINE_CHECKED
+faulted:
+        io_flush(io);
+        for (int i = 0; i < 8; i++) {
+                r[i] = reg[i];
+                fault->registers[i] = reg[i];
+        }
+        fault->instruction = (fault->kind == UM_FAULT_BAD_PC) ? 0 :
+                             get_segment(mem, 0)[fault->pc];
+        *start = fault->pc;
+        return true;
+#endif
+}
+
+#if UM_THREADED
+#pragma GCC diagnostic pop
+#endif
+
+#undef ENGINE_STEP
+#undef ENGINE_COST
+#undef ENGINE_HOOK
+#undef ENGINE_ENTER
+#undef ENGINE_JIT_BUDGET
+#undef ENGINE_LOADP
+#undef ENGINE_CHECK
+#undef ENGINE_CHECK_WORD
+#undef ENGINE_GUARD
+#undef JIT_HOOK
+#undef SUSPEND_HOOK
+#undef BUDGET_HOOK
+#undef TRACE_HOOK
+#undef TRACE_REG
+#undef ENGINE_SUSPEND
+#undef ENGINE_BUDGET
+#undef ENGINE_CHECKED
+#undef ENGINE_TRACE
+#undef ENGINE_JIT
+#undef ENGINE_PROFILE
+#undef ENGINE_NAME
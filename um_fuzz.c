@@ -0,0 +1,282 @@
+/******************************************************************************
+*       um_fuzz.c
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the fuzzer for the um's memory and segment code.
+*       Each case is a random valid program from um_generate, heavy on map,
+*       unmap, segmented load and store, and load program, which is loaded
+*       with populate_bytes and run four times: by execute_program (where
+*       a bug shows as a crash), by execute_checked (which must not find a
+*       fault), by execute_jit_budgeted (with a jit that compiles every
+*       block the first time it is entered, since the generated programs
+*       only jump forward), and by execute_reference, whose output,
+*       registers and memory at the halt the other three must match.
+*
+*       LLVMFuzzerTestOneInput is the libFuzzer entry point: the fuzzer's
+*       bytes drive the generator's choices. Built with -DUM_LIBFUZZER and
+*       -fsanitize=fuzzer (make um_fuzz_libfuzzer) libFuzzer supplies main;
+*       otherwise main below runs seeded cases:
+*
+*       Usage: um_fuzz [-n cases] [-s seed] [-o program.um] [input ...]
+*
+*       Runs cases from consecutive seeds (1000 from seed 1 by default), or
+*       runs each input file as fuzzer bytes (to replay a crash libFuzzer
+*       found). -o writes the program for the seed to a file instead.
+*
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include "memory_type.h"
+#include "um_populate.h"
+#include "um_operations.h"
+#include "um_io.h"
+#include "um_jit.h"
+#include "um_generate.h"
+
+#define MAX_STEPS 2000
+#define DEFAULT_CASES 1000
+
+/*
+*       Description: The four ways a case is run.
+*/
+enum { FAST, CHECKED, JIT, REFERENCE, NUM_RUNS };
+
+static const char *const run_names[NUM_RUNS] = {
+        "execute_program", "execute_checked", "execute_jit_budgeted",
+        "execute_reference"
+};
+
+/*
+*       Description: Runs a generated program four ways and checks that
+*       it halts without a fault and ends the same each way.
+*
+*       In/Out Expectations: Expects the program's words and their number,
+*       and a name for the case in messages. Returns true if all is well;
+*       otherwise prints what went wrong to stderr and returns false.
+*/
+static bool run_case(const uint32_t *program, size_t length,
+                     const char *name)
+{
+        unsigned char *bytes = program_bytes(program, length);
+        memory mems[NUM_RUNS];
+        io_buffer ios[NUM_RUNS];
+        uint32_t r[NUM_RUNS][8];
+        Um_fault fault;
+        Um_status status = UM_HALTED;
+        for (int i = 0; i < NUM_RUNS; i++) {
+                uint32_t pc = 0;
+                memset(r[i], 0, sizeof(r[i]));
+                mems[i] = new_memory();
+                ios[i] = new_io_bytes(NULL, 0, true);
+                populate_bytes(bytes, length * 4, mems[i]);
+                if (i == FAST) {
+                        execute_program(mems[i], r[i], ios[i]);
+                } else if (i == CHECKED) {
+                        status = execute_checked(mems[i], r[i], &pc, ios[i],
+                                                 &fault);
+                } else if (i == JIT) {
+                        jit j = new_jit(mems[i], 1, true);
+                        uint64_t budget = UINT64_MAX;
+                        execute_jit_budgeted(mems[i], r[i], &pc, ios[i], j,
+                                             &budget);
+                        if (j != NULL) {
+                                free_jit(j);
+                        }
+                } else {
+                        execute_reference(mems[i], r[i], ios[i]);
+                }
+        }
+
+        bool ok = true;
+        if (status != UM_HALTED) {
+                fprintf(stderr, "%s: ", name);
+                report_fault(&fault, stderr);
+                ok = false;
+        }
+        size_t expected_length;
+        const unsigned char *expected = io_output(ios[REFERENCE],
+                                                  &expected_length);
+        for (int i = 0; i < REFERENCE && ok; i++) {
+                size_t out_length;
+                const unsigned char *out = io_output(ios[i], &out_length);
+                if (out_length != expected_length || (out_length > 0 &&
+                    memcmp(out, expected, out_length) != 0)) {
+                        fprintf(stderr, "%s: %s printed %zu bytes that "
+                                "differ from execute_reference's %zu.\n",
+                                name, run_names[i], out_length,
+                                expected_length);
+                        ok = false;
+                }
+                uint32_t seg, index;
+                if (ok && (memcmp(r[i], r[REFERENCE], sizeof(r[i])) != 0 ||
+                    !memory_equal(mems[i], mems[REFERENCE], &seg, &index))) {
+                        fprintf(stderr, "%s: %s halted with different "
+                                "registers or memory from "
+                                "execute_reference's.\n", name,
+                                run_names[i]);
+                        ok = false;
+                }
+        }
+
+        for (int i = 0; i < NUM_RUNS; i++) {
+                free_io(ios[i]);
+                free_memory(mems[i]);
+        }
+        free(bytes);
+        return ok;
+}
+
+/*
+*       Description: The libFuzzer entry point: generates a program from
+*       the fuzzer's bytes and runs it, aborting if anything is wrong.
+*
+*       In/Out Expectations: Expects the bytes and their number. Returns 0.
+*/
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+        size_t length;
+        uint32_t *program = generate_program(data, size, 0, MAX_STEPS,
+                                             &length);
+        if (!run_case(program, length, "fuzzer input")) {
+                abort();
+        }
+        free(program);
+        return 0;
+}
+
+#ifndef UM_LIBFUZZER
+
+/*
+*       Description: Writes the program for a seed to a .um file.
+*
+*       In/Out Expectations: Expects the seed and the file name. Returns
+*       false if the file can't be written.
+*/
+static bool write_program(uint64_t seed, const char *filename)
+{
+        size_t length;
+        uint32_t *program = generate_program(NULL, 0, seed, MAX_STEPS,
+                                             &length);
+        unsigned char *bytes = program_bytes(program, length);
+        FILE *fp = fopen(filename, "w");
+        bool ok = fp != NULL && fwrite(bytes, 4, length, fp) == length;
+        if (fp != NULL) {
+                ok = (fclose(fp) == 0) && ok;
+        }
+        free(bytes);
+        free(program);
+        return ok;
+}
+
+/*
+*       Description: Runs a file's bytes as one fuzzer input.
+*
+*       In/Out Expectations: Expects the file name. Returns false if the
+*       file can't be read or the case fails.
+*/
+static bool run_input(const char *filename)
+{
+        FILE *fp = fopen(filename, "r");
+        if (fp == NULL) {
+                fprintf(stderr, "Error: %s can't be read.\n", filename);
+                return false;
+        }
+        size_t capacity = 4096, size = 0, got;
+        uint8_t *data = malloc(capacity);
+        while ((got = fread(data + size, 1, capacity - size, fp)) > 0) {
+                size += got;
+                if (size == capacity) {
+                        capacity *= 2;
+                        data = realloc(data, capacity);
+                }
+        }
+        fclose(fp);
+
+        size_t length;
+        uint32_t *program = generate_program(data, size, 0, MAX_STEPS,
+                                             &length);
+        bool ok = run_case(program, length, filename);
+        free(program);
+        free(data);
+        return ok;
+}
+
+/*
+*       Description: Runs seeded cases or fuzzer inputs.
+*
+*       In/Out Expectations: Expects the usage above. Returns exit failure
+*       if any case fails or a file can't be read or written.
+*/
+int main(int argc, char *argv[])
+{
+        uint64_t cases = DEFAULT_CASES;
+        uint64_t seed = 1;
+        const char *out = NULL;
+        bool usage = false;
+
+        int opt;
+        while ((opt = getopt(argc, argv, "n:s:o:")) != -1) {
+                switch (opt) {
+                case 'n':
+                        cases = strtoull(optarg, NULL, 10);
+                        break;
+                case 's':
+                        seed = strtoull(optarg, NULL, 10);
+                        break;
+                case 'o':
+                        out = optarg;
+                        break;
+                default:
+                        usage = true;
+                        break;
+                }
+        }
+        if (usage || (out != NULL && optind < argc)) {
+                fprintf(stderr, "Usage: %s [-n cases] [-s seed] "
+                        "[-o program.um] [input ...]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+
+        if (out != NULL) {
+                if (!write_program(seed, out)) {
+                        fprintf(stderr, "Error: %s can't be written.\n",
+                                out);
+                        return EXIT_FAILURE;
+                }
+                return EXIT_SUCCESS;
+        }
+
+        uint64_t failed = 0;
+        if (optind < argc) {
+                for (int i = optind; i < argc; i++) {
+                        failed += !run_input(argv[i]);
+                }
+                return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        uint64_t words = 0;
+        for (uint64_t s = seed; s < seed + cases; s++) {
+                char name[32];
+                snprintf(name, sizeof(name), "seed %" PRIu64, s);
+                size_t length;
+                uint32_t *program = generate_program(NULL, 0, s, MAX_STEPS,
+                                                     &length);
+                failed += !run_case(program, length, name);
+                words += length;
+                free(program);
+        }
+        printf("um_fuzz: %" PRIu64 " cases (%" PRIu64 " words), %" PRIu64
+               " failed\n", cases, words, failed);
+        return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#endif
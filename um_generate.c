@@ -0,0 +1,557 @@
+/******************************************************************************
+*       um_generate.c
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the implementation of the random program
+*       generator. It builds instructions with three_register and loadval
+*       (as in um-lab), and keeps a model of the program's state while it
+*       writes: for each register and each word of each segment it mapped,
+*       whether the value is a known number, the id of a segment it mapped,
+*       or unknown. Every instruction it writes is one the model says is
+*       safe: segment ids come from map (and are dropped once unmapped),
+*       indices and lengths are loaded just before use, divisors and output
+*       values are known, and load program only jumps forward in segment 0
+*       or, at the end, loads a short program stored in a new segment.
+*       Stores to segment 0 only write words that have already run. The
+*       program is straight-line, so it always reaches its halt.
+*
+******************************************************************************/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include "um_generate.h"
+#include "um_bitpack.h"
+
+#define NUM_REGISTERS 8
+/* With this many segments mapped, unmapping is chosen over mapping */
+#define MAX_LIVE 256
+/* Most segments fit the slab size classes; some are longer */
+#define SMALL_WORDS 64
+#define MAX_WORDS 4096
+#define MAX_GAP 3
+#define MAX_TAIL 16
+
+/*
+*       Description: What the generator knows about a value: a number, the
+*       segment it mapped as model segment n (while that is still mapped),
+*       or nothing.
+*/
+enum { KNOWN, HANDLE, UNKNOWN };
+
+struct value {
+        uint8_t kind;
+        uint32_t n;
+};
+
+/*
+*       Description: A segment the program mapped. Model segments are never
+*       reused, so a handle to an unmapped one stays stale even if the um
+*       gives its id to a later map.
+*/
+struct model_seg {
+        struct value *words;
+        uint32_t length;
+        bool mapped;
+};
+
+/*
+*       Description: The generator's state: where choices come from (the
+*       bytes if any, else the xorshift state), the program so far, and the
+*       model of the registers and segments.
+*/
+struct generator {
+        const uint8_t *choices;
+        size_t length;
+        size_t pos;
+        uint64_t state;
+        bool done;
+        uint32_t *program;
+        size_t count;
+        size_t capacity;
+        struct value reg[NUM_REGISTERS];
+        struct model_seg *segs;
+        size_t num_segs;
+        size_t seg_capacity;
+        size_t live;
+};
+
+/*
+*       Description: Builds a three register instruction word.
+*
+*       In/Out Expectations: Expects an opcode and three register numbers
+*       from 0 to 7. Returns the word.
+*/
+uint32_t three_register(Um_opcode op, unsigned ra, unsigned rb, unsigned rc)
+{
+        uint64_t result = 0;
+        result = um_newu(result, 4, 28, op);
+        result = um_newu(result, 3, 0, rc);
+        result = um_newu(result, 3, 3, rb);
+        result = um_newu(result, 3, 6, ra);
+        return result;
+}
+
+/*
+*       Description: Builds a load value instruction word.
+*
+*       In/Out Expectations: Expects a register number and a value that
+*       fits in 25 bits. Returns the word.
+*/
+uint32_t loadval(unsigned ra, unsigned val)
+{
+        uint64_t result = 0;
+        result = um_newu(result, 4, 28, LOADV);
+        result = um_newu(result, 3, 25, ra);
+        result = um_newu(result, 25, 0, val);
+        return result;
+}
+
+/*
+*       Description: Makes one choice. Fuzzer bytes are used one at a time
+*       (four for a choice of more than 256); once they run out the
+*       generator is done and every choice is 0.
+*
+*       In/Out Expectations: Expects a generator and the number of options,
+*       at least 1. Returns a number below it.
+*/
+static uint32_t choose(struct generator *g, uint32_t n)
+{
+        uint32_t v = 0;
+        if (g->choices == NULL) {
+                g->state ^= g->state << 13;
+                g->state ^= g->state >> 7;
+                g->state ^= g->state << 17;
+                v = g->state >> 32;
+        } else {
+                int bytes = (n > 256) ? 4 : 1;
+                for (int i = 0; i < bytes; i++) {
+                        if (g->pos == g->length) {
+                                g->done = true;
+                                return 0;
+                        }
+                        v = (v << 8) | g->choices[g->pos++];
+                }
+        }
+        return v % n;
+}
+
+static uint32_t random_word(struct generator *g)
+{
+        return (choose(g, 1u << 16) << 16) | choose(g, 1u << 16);
+}
+
+static void emit(struct generator *g, uint32_t word)
+{
+        if (g->count == g->capacity) {
+                g->capacity *= 2;
+                g->program = realloc(g->program,
+                                     g->capacity * sizeof(*g->program));
+                assert(g->program != NULL);
+        }
+        g->program[g->count++] = word;
+}
+
+static struct value known(uint32_t n)
+{
+        struct value v = { KNOWN, n };
+        return v;
+}
+
+static bool is_handle(struct generator *g, struct value v)
+{
+        return v.kind == HANDLE && g->segs[v.n].mapped;
+}
+
+/*
+*       Description: Loads a register with a value, and records it.
+*/
+static void set(struct generator *g, unsigned r, uint32_t val)
+{
+        assert(um_fitsu(val, 25));
+        emit(g, loadval(r, val));
+        g->reg[r] = known(val);
+}
+
+/*
+*       Description: Picks a register other than two to keep (which can be
+*       the same one).
+*/
+static unsigned pick_other(struct generator *g, unsigned a, unsigned b)
+{
+        unsigned candidates[NUM_REGISTERS];
+        unsigned n = 0;
+        for (unsigned r = 0; r < NUM_REGISTERS; r++) {
+                if (r != a && r != b) {
+                        candidates[n++] = r;
+                }
+        }
+        return candidates[choose(g, n)];
+}
+
+static unsigned pick(struct generator *g)
+{
+        return choose(g, NUM_REGISTERS);
+}
+
+/*
+*       Description: Picks a register holding a mapped segment's id.
+*
+*       In/Out Expectations: Expects a generator and whether the segment
+*       must have words. Returns the register, or -1 if there is none.
+*/
+static int find_handle(struct generator *g, bool need_words)
+{
+        unsigned candidates[NUM_REGISTERS];
+        unsigned n = 0;
+        for (unsigned r = 0; r < NUM_REGISTERS; r++) {
+                if (is_handle(g, g->reg[r]) &&
+                    (!need_words || g->segs[g->reg[r].n].length > 0)) {
+                        candidates[n++] = r;
+                }
+        }
+        return n == 0 ? -1 : (int)candidates[choose(g, n)];
+}
+
+/*
+*       Description: Maps a segment of a given length into a register.
+*/
+static void map_length(struct generator *g, unsigned b, uint32_t length)
+{
+        unsigned c = pick_other(g, b, b);
+        set(g, c, length);
+        emit(g, three_register(MAP, 0, b, c));
+
+        if (g->num_segs == g->seg_capacity) {
+                g->seg_capacity *= 2;
+                g->segs = realloc(g->segs,
+                                  g->seg_capacity * sizeof(*g->segs));
+                assert(g->segs != NULL);
+        }
+        struct model_seg *seg = &g->segs[g->num_segs];
+        seg->words = calloc(length > 0 ? length : 1, sizeof(*seg->words));
+        assert(seg->words != NULL);
+        seg->length = length;
+        seg->mapped = true;
+        g->reg[b].kind = HANDLE;
+        g->reg[b].n = g->num_segs++;
+        g->live++;
+}
+
+static void gen_unmap(struct generator *g);
+
+static void gen_map(struct generator *g)
+{
+        if (g->live >= MAX_LIVE && find_handle(g, false) >= 0) {
+                gen_unmap(g);
+                return;
+        }
+        uint32_t kind = choose(g, 10);
+        uint32_t length = (kind < 8) ? choose(g, SMALL_WORDS + 1) :
+                          (kind == 8) ? choose(g, MAX_WORDS) : 1;
+        map_length(g, pick(g), length);
+}
+
+static void gen_unmap(struct generator *g)
+{
+        int c = find_handle(g, false);
+        if (c < 0) {
+                gen_map(g);
+                return;
+        }
+        emit(g, three_register(UNMAP, 0, 0, c));
+        struct model_seg *seg = &g->segs[g->reg[c].n];
+        seg->mapped = false;
+        free(seg->words);
+        seg->words = NULL;
+        g->live--;
+}
+
+static void gen_sstore(struct generator *g)
+{
+        int a = find_handle(g, true);
+        if (a < 0) {
+                gen_map(g);
+                return;
+        }
+        struct model_seg *seg = &g->segs[g->reg[a].n];
+        uint32_t index = choose(g, seg->length);
+        unsigned b = pick_other(g, a, a);
+        set(g, b, index);
+        unsigned c = pick(g);
+        emit(g, three_register(SSTORE, a, b, c));
+        seg->words[index] = g->reg[c];
+}
+
+static void gen_sload(struct generator *g)
+{
+        int b = find_handle(g, true);
+        if (b < 0) {
+                gen_map(g);
+                return;
+        }
+        struct model_seg *seg = &g->segs[g->reg[b].n];
+        uint32_t index = choose(g, seg->length);
+        unsigned c = pick_other(g, b, b);
+        set(g, c, index);
+        unsigned a = pick(g);
+        emit(g, three_register(SLOAD, a, b, c));
+        g->reg[a] = seg->words[index];
+}
+
+/*
+*       Description: Loads from or stores to a word of segment 0 that has
+*       already run (or is never run), so the program is unchanged.
+*/
+static void gen_code_access(struct generator *g)
+{
+        if (g->count == 0) {
+                return;
+        }
+        uint32_t index = choose(g, g->count);
+        unsigned a = pick(g);
+        set(g, a, 0);
+        unsigned b = pick_other(g, a, a);
+        set(g, b, index);
+        unsigned c = pick(g);
+        if (choose(g, 2) == 0) {
+                emit(g, three_register(SSTORE, a, b, c));
+        } else {
+                emit(g, three_register(SLOAD, c, a, b));
+                g->reg[c].kind = UNKNOWN;
+        }
+}
+
+/*
+*       Description: Jumps forward within segment 0 over up to MAX_GAP
+*       random words, which never run.
+*/
+static void gen_jump(struct generator *g)
+{
+        uint32_t gap = choose(g, MAX_GAP + 1);
+        unsigned b = pick(g);
+        set(g, b, 0);
+        unsigned c = pick_other(g, b, b);
+        /* the target is after this load value, the load program and gap */
+        set(g, c, g->count + 2 + gap);
+        emit(g, three_register(LOADP, 0, b, c));
+        for (uint32_t i = 0; i < gap; i++) {
+                emit(g, random_word(g));
+        }
+}
+
+static void gen_arithmetic(struct generator *g)
+{
+        static const Um_opcode ops[] = { ADD, MUL, NAND };
+        Um_opcode op = ops[choose(g, 3)];
+        unsigned a = pick(g), b = pick(g), c = pick(g);
+        emit(g, three_register(op, a, b, c));
+        struct value x = g->reg[b], y = g->reg[c];
+        if (x.kind != KNOWN || y.kind != KNOWN) {
+                g->reg[a].kind = UNKNOWN;
+        } else if (op == ADD) {
+                g->reg[a] = known(x.n + y.n);
+        } else if (op == MUL) {
+                g->reg[a] = known(x.n * y.n);
+        } else {
+                g->reg[a] = known(~(x.n & y.n));
+        }
+}
+
+static void gen_division(struct generator *g)
+{
+        unsigned c = pick(g);
+        if (g->reg[c].kind != KNOWN || g->reg[c].n == 0) {
+                set(g, c, 1 + choose(g, 1000));
+        }
+        unsigned a = pick(g), b = pick(g);
+        emit(g, three_register(DIV, a, b, c));
+        struct value x = g->reg[b];
+        if (x.kind == KNOWN) {
+                g->reg[a] = known(x.n / g->reg[c].n);
+        } else {
+                g->reg[a].kind = UNKNOWN;
+        }
+}
+
+static void gen_cmov(struct generator *g)
+{
+        unsigned a = pick(g), b = pick(g), c = pick(g);
+        emit(g, three_register(CMOV, a, b, c));
+        struct value cond = g->reg[c];
+        if (cond.kind == KNOWN) {
+                if (cond.n != 0) {
+                        g->reg[a] = g->reg[b];
+                }
+        } else if (g->reg[a].kind != g->reg[b].kind ||
+                   g->reg[a].n != g->reg[b].n) {
+                g->reg[a].kind = UNKNOWN;
+        }
+}
+
+static void gen_loadv(struct generator *g)
+{
+        set(g, pick(g), choose(g, 1u << 25));
+}
+
+static void gen_output(struct generator *g)
+{
+        unsigned c = pick(g);
+        if (g->reg[c].kind != KNOWN || g->reg[c].n > 255) {
+                set(g, c, choose(g, 256));
+        }
+        emit(g, three_register(OUT, 0, 0, c));
+}
+
+/*
+*       Description: Reads a byte. Generated programs are run with no
+*       input, so it is always the end of input, all ones.
+*/
+static void gen_input(struct generator *g)
+{
+        unsigned c = pick(g);
+        emit(g, three_register(IN, 0, 0, c));
+        g->reg[c] = known(~(uint32_t)0);
+}
+
+/*
+*       Description: Ends the program by building a short program in a new
+*       segment, one word at a time, and loading it. It starts at an
+*       offset past some random words, runs some arithmetic and output,
+*       and halts.
+*/
+static void gen_tail(struct generator *g)
+{
+        uint32_t tail[MAX_TAIL];
+        uint32_t length = 1 + choose(g, MAX_TAIL);
+        uint32_t start = choose(g, length);
+        for (uint32_t i = 0; i < start; i++) {
+                tail[i] = random_word(g);
+        }
+        for (uint32_t i = start; i + 1 < length; i++) {
+                unsigned r = pick(g);
+                if (i + 2 < length && choose(g, 4) == 0) {
+                        tail[i++] = loadval(r, choose(g, 256));
+                        tail[i] = three_register(OUT, 0, 0, r);
+                } else if (choose(g, 2) == 0) {
+                        tail[i] = loadval(r, choose(g, 1u << 25));
+                } else {
+                        static const Um_opcode ops[] = { ADD, MUL, NAND,
+                                                         CMOV };
+                        tail[i] = three_register(ops[choose(g, 4)], r,
+                                                 pick(g), pick(g));
+                }
+        }
+        tail[length - 1] = three_register(HALT, 0, 0, 0);
+
+        unsigned h = pick(g);
+        map_length(g, h, length);
+        unsigned x = pick_other(g, h, h);
+        unsigned y = pick_other(g, h, x);
+        for (uint32_t i = 0; i < length; i++) {
+                /* word = (word >> 7) * 128 + (word & 127) */
+                set(g, x, tail[i] >> 7);
+                set(g, y, 128);
+                emit(g, three_register(MUL, x, x, y));
+                set(g, y, tail[i] & 127);
+                emit(g, three_register(ADD, x, x, y));
+                set(g, y, i);
+                emit(g, three_register(SSTORE, h, y, x));
+        }
+        set(g, x, start);
+        emit(g, three_register(LOADP, 0, h, x));
+}
+
+/*
+*       Description: How often each kind of step is chosen; the memory
+*       steps dominate.
+*/
+static const struct step {
+        void (*generate)(struct generator *g);
+        uint32_t weight;
+} steps[] = {
+        { gen_map, 6 }, { gen_unmap, 5 }, { gen_sstore, 6 },
+        { gen_sload, 6 }, { gen_code_access, 2 }, { gen_jump, 2 },
+        { gen_arithmetic, 3 }, { gen_division, 1 }, { gen_cmov, 1 },
+        { gen_loadv, 1 }, { gen_output, 1 }, { gen_input, 1 }
+};
+
+#define NUM_STEPS (sizeof(steps) / sizeof(steps[0]))
+
+/*
+*       Description: Generates a random valid program.
+*
+*       In/Out Expectations: Expects the bytes to take choices from (NULL
+*       to use the seed instead) and their length, a seed, the most steps
+*       to generate (each is a few instructions), and a place to store the
+*       program's length in words. Returns the program's words, to be
+*       freed. With bytes, the program ends once they run out. The same
+*       bytes or seed always give the same program.
+*/
+uint32_t *generate_program(const uint8_t *choices, size_t length,
+                           uint64_t seed, size_t max_steps,
+                           size_t *program_length)
+{
+        struct generator g;
+        memset(&g, 0, sizeof(g));
+        g.choices = choices;
+        g.length = length;
+        g.state = seed * 0x9e3779b97f4a7c15 + 1;
+        g.capacity = 64;
+        g.program = malloc(g.capacity * sizeof(*g.program));
+        g.seg_capacity = 16;
+        g.segs = malloc(g.seg_capacity * sizeof(*g.segs));
+        assert(g.program != NULL && g.segs != NULL);
+        for (int r = 0; r < NUM_REGISTERS; r++) {
+                g.reg[r] = known(0);
+        }
+
+        uint32_t total = 0;
+        for (size_t i = 0; i < NUM_STEPS; i++) {
+                total += steps[i].weight;
+        }
+        for (size_t n = 0; n < max_steps && !g.done; n++) {
+                uint32_t roll = choose(&g, total);
+                size_t i = 0;
+                while (roll >= steps[i].weight) {
+                        roll -= steps[i].weight;
+                        i++;
+                }
+                steps[i].generate(&g);
+        }
+        if (choose(&g, 4) == 0) {
+                gen_tail(&g);
+        } else {
+                emit(&g, three_register(HALT, 0, 0, 0));
+        }
+
+        for (size_t i = 0; i < g.num_segs; i++) {
+                free(g.segs[i].words);
+        }
+        free(g.segs);
+        *program_length = g.count;
+        return g.program;
+}
+
+/*
+*       Description: Converts a program to the big-endian bytes of a .um
+*       file.
+*
+*       In/Out Expectations: Expects the words and their number. Returns
+*       the bytes, four per word, to be freed.
+*/
+unsigned char *program_bytes(const uint32_t *program, size_t length)
+{
+        unsigned char *bytes = malloc(length * 4 + 1);
+        assert(bytes != NULL);
+        for (size_t i = 0; i < length; i++) {
+                for (int j = 0; j < 4; j++) {
+                        bytes[i * 4 + j] = program[i] >> (24 - 8 * j);
+                }
+        }
+        return bytes;
+}
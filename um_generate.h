@@ -0,0 +1,34 @@
+/******************************************************************************
+*       um_generate.h
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the declarations for the random program
+*       generator. It writes programs that are random but valid: they map,
+*       unmap, load from and store to segments over and over, jump forward
+*       with load program, and may end by loading a program they built in
+*       another segment, but never fault, so any crash or difference while
+*       running one is a bug in the um. Its choices come from a seed or
+*       from a fuzzer's bytes.
+*
+******************************************************************************/
+
+#ifndef UM_GENERATE_
+#define UM_GENERATE_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "um_decode.h"
+
+uint32_t three_register(Um_opcode op, unsigned ra, unsigned rb,
+                        unsigned rc);
+uint32_t loadval(unsigned ra, unsigned val);
+
+uint32_t *generate_program(const uint8_t *choices, size_t length,
+                           uint64_t seed, size_t max_steps,
+                           size_t *program_length);
+unsigned char *program_bytes(const uint32_t *program, size_t length);
+
+#endif
@@ -0,0 +1,396 @@
+/******************************************************************************
+*       um_io.c
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the implementation of the um's input/output
+*       buffers. Each io_buffer holds one output buffer and one input
+*       buffer, refilled and emptied a chunk at a time through a reader and
+*       a writer. The buffers from new_io use read(2) and write(2) on a
+*       pair of file descriptors directly rather than stdio; those from
+*       new_io_bytes read bytes fed to them and collect their output in
+*       memory, so machines can run side by side; and new_io_callbacks 
+*       takes the reader and writer from the caller. A reader can say that
+*       no input is there yet (IO_WOULD_BLOCK), which io_blocked reports.
+*
+******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <assert.h>
+#include "um_io.h"
+
+#define IO_BUFFER_SIZE 65536
+
+/*
+*       read, write and cl are the reader, writer and their closure; at_eof
+*       is set when io_blocked has seen the end of input, for io_get. The
+*       built-in readers and writers use cl = the io_buffer itself, and
+*       the fields after it: the descriptors for new_io, and for
+*       new_io_bytes the growable fed array (fed_pos of fed_length used, 
+*       closed once no more will come) and the growable collected array.
+*/
+struct io_buffer {
+        io_reader read;
+        io_writer write;
+        void *cl;
+        size_t flush_at;
+        bool at_eof;
+        int in_fd;
+        int out_fd;
+        unsigned char *fed;
+        size_t fed_length;
+        size_t fed_pos;
+        size_t fed_capacity;
+        bool closed;
+        unsigned char *collected;
+        size_t collected_length;
+        size_t collected_capacity;
+        size_t out_length;
+        size_t in_pos;
+        size_t in_length;
+        unsigned char out[IO_BUFFER_SIZE];
+        unsigned char in[IO_BUFFER_SIZE];
+};
+
+/*
+*       Description: Creates the buffers for a reader and a writer.
+*
+*       In/Out Expectations: Expects a reader, a writer, the closure to pass
+*       them, and the number of buffered output bytes that triggers a
+*       write; 0 or anything above the buffer size means "when the buffer is
+*       full". Returns a new io_buffer, to be freed with free_io.
+*/
+static io_buffer make_io(io_reader read, io_writer write, void *cl,
+                         size_t flush_at)
+{
+        io_buffer io = malloc(sizeof(*io));
+        assert(io != NULL);
+        io->read = read;
+        io->write = write;
+        io->cl = cl;
+        io->flush_at = (flush_at == 0 || flush_at > IO_BUFFER_SIZE) ?
+                       IO_BUFFER_SIZE : flush_at;
+        io->at_eof = false;
+        io->in_fd = -1;
+        io->out_fd = -1;
+        io->fed = NULL;
+        io->fed_length = 0;
+        io->fed_pos = 0;
+        io->fed_capacity = 0;
+        io->closed = false;
+        io->collected = NULL;
+        io->collected_length = 0;
+        io->collected_capacity = 0;
+        io->out_length = 0;
+        io->in_pos = 0;
+        io->in_length = 0;
+        return io;
+}
+
+/*
+*       Description: The reader for new_io: reads from the input descriptor,
+*       retrying interrupted reads.
+*
+*       In/Out Expectations: Expects the io_buffer, and room for max bytes.
+*       Returns the number of bytes read, IO_WOULD_BLOCK if the descriptor
+*       is non-blocking and has nothing yet, or 0 at end of input or on 
+*       error.
+*/
+static size_t read_fd(void *cl, unsigned char *bytes, size_t max)
+{
+        io_buffer io = cl;
+        ssize_t got;
+        do {
+                got = read(io->in_fd, bytes, max);
+        } while (got < 0 && errno == EINTR);
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return IO_WOULD_BLOCK;
+        }
+        return got > 0 ? (size_t)got : 0;
+}
+
+/*
+*       Description: The writer for new_io: writes everything to the output
+*       descriptor.
+*
+*       In/Out Expectations: Expects the io_buffer and the bytes. Retries
+*       short and interrupted writes; on any other write error the bytes
+*       are dropped, as there is nowhere left to report them. Returns
+*       nothing.
+*/
+static void write_fd(void *cl, const unsigned char *bytes, size_t length)
+{
+        io_buffer io = cl;
+        size_t done = 0;
+        while (done < length) {
+                ssize_t wrote = write(io->out_fd, bytes + done,
+                                      length - done);
+                if (wrote < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (wrote <= 0) {
+                        break;
+                }
+                done += wrote;
+        }
+}
+
+/*
+*       Description: The reader for new_io_bytes: copies the next bytes fed
+*       to the io_buffer.
+*
+*       In/Out Expectations: Expects the io_buffer, and room for max bytes.
+*       Returns the number of bytes copied; if none are left, 0 once the
+*       input is closed and IO_WOULD_BLOCK until then.
+*/
+static size_t read_bytes(void *cl, unsigned char *bytes, size_t max)
+{
+        io_buffer io = cl;
+        size_t got = io->fed_length - io->fed_pos;
+        if (got == 0) {
+                return io->closed ? 0 : IO_WOULD_BLOCK;
+        }
+        if (got > max) {
+                got = max;
+        }
+        memcpy(bytes, io->fed + io->fed_pos, got);
+        io->fed_pos += got;
+        return got;
+}
+
+/*
+*       Description: The writer for new_io_bytes: appends the bytes to the
+*       collected output.
+*
+*       In/Out Expectations: Expects the io_buffer and the bytes. Returns
+*       nothing.
+*/
+static void collect_bytes(void *cl, const unsigned char *bytes,
+                          size_t length)
+{
+        io_buffer io = cl;
+        size_t needed = io->collected_length + length;
+        if (needed > io->collected_capacity) {
+                io->collected_capacity = 2 * needed;
+                io->collected = realloc(io->collected, io->collected_capacity);
+                assert(io->collected != NULL);
+        }
+        memcpy(io->collected + io->collected_length, bytes, length);
+        io->collected_length = needed;
+}
+
+/*
+*       Description: Creates the buffers for a pair of file descriptors.
+*
+*       In/Out Expectations: Expects a descriptor to read input from, one to
+*       write output to, and the number of buffered output bytes that
+*       triggers a write; 0 or anything above the buffer size means "when
+*       the buffer is full". Returns a new io_buffer, to be freed with
+*       free_io.
+*/
+io_buffer new_io(int in_fd, int out_fd, size_t flush_at)
+{
+        io_buffer io = make_io(read_fd, write_fd, NULL, flush_at);
+        io->cl = io;
+        io->in_fd = in_fd;
+        io->out_fd = out_fd;
+        return io;
+}
+
+/*
+*       Description: Creates buffers that read input from bytes in memory 
+*       and keep all output in memory instead of using file descriptors.
+*
+*       In/Out Expectations: Expects the input bytes (NULL for none) and
+*       their length, which are copied. When closed is false, more input 
+*       can be added with io_feed until io_close_input; otherwise this is 
+*       all of it. Returns a new io_buffer, to be freed with free_io. The 
+*       output so far can be got with io_output.
+*/
+io_buffer new_io_bytes(const unsigned char *input, size_t length, 
+                       bool closed)
+{
+        io_buffer io = make_io(read_bytes, collect_bytes, NULL, 0);
+        io->cl = io;
+        if (input != NULL) {
+                io_feed(io, input, length);
+        }
+        io->closed = closed;
+        return io;
+}
+
+/*
+*       Description: Adds input to an io_buffer from new_io_bytes, after
+*       what it already has.
+*
+*       In/Out Expectations: Expects an io_buffer from new_io_bytes whose
+*       input isn't closed, and the bytes, which are copied. Returns 
+*       nothing.
+*/
+void io_feed(io_buffer io, const unsigned char *input, size_t length)
+{
+        assert(io->read == read_bytes && !io->closed);
+        if (io->fed_pos == io->fed_length) {
+                io->fed_pos = 0;
+                io->fed_length = 0;
+        }
+        size_t needed = io->fed_length + length;
+        if (needed > io->fed_capacity) {
+                io->fed_capacity = 2 * needed;
+                io->fed = realloc(io->fed, io->fed_capacity);
+                assert(io->fed != NULL);
+        }
+        if (length > 0) {
+                memcpy(io->fed + io->fed_length, input, length);
+        }
+        io->fed_length = needed;
+}
+
+/*
+*       Description: Marks the end of an io_buffer from new_io_bytes' input:
+*       once what was fed is used up, input reads as end of file.
+*
+*       In/Out Expectations: Expects an io_buffer from new_io_bytes. 
+*       Returns nothing.
+*/
+void io_close_input(io_buffer io)
+{
+        assert(io->read == read_bytes);
+        io->closed = true;
+}
+
+/*
+*       Description: Creates buffers that get input from, and hand output
+*       to, functions supplied by the caller (for a um embedded in another
+*       program).
+*
+*       In/Out Expectations: Expects a reader, which fills up to max bytes
+*       and returns how many it filled (0 meaning end of input); a writer,
+*       which takes every byte it is given; and a closure passed to both.
+*       The reader may return IO_WOULD_BLOCK when it has nothing yet (see
+*       io_blocked).
+*       Output is handed over when the buffer fills, before input is read,
+*       and when the program halts or stops. Returns a new io_buffer, to be
+*       freed with free_io.
+*/
+io_buffer new_io_callbacks(io_reader read, io_writer write, void *cl)
+{
+        return make_io(read, write, cl, 0);
+}
+
+/*
+*       Description: Gets the output collected by an io_buffer from
+*       new_io_bytes, flushing what is still buffered.
+*
+*       In/Out Expectations: Expects an io_buffer from new_io_bytes and a
+*       pointer to store the number of bytes in. Returns the bytes, which
+*       belong to the io_buffer and are good until its next output or
+*       free_io (NULL if there are none).
+*/
+const unsigned char *io_output(io_buffer io, size_t *length)
+{
+        io_flush(io);
+        *length = io->collected_length;
+        return io->collected;
+}
+
+/*
+*       Description: Flushes any buffered output and frees the buffers.
+*
+*       In/Out Expectations: Expects an io_buffer from new_io, new_io_bytes
+*       or new_io_callbacks. Does not close the file descriptors. Returns
+*       nothing.
+*/
+void free_io(io_buffer io)
+{
+        io_flush(io);
+        free(io->fed);
+        free(io->collected);
+        free(io);
+}
+
+/*
+*       Description: Hands all buffered output to the writer.
+*
+*       In/Out Expectations: Expects a valid io_buffer. Returns nothing.
+*/
+void io_flush(io_buffer io)
+{
+        if (io->out_length > 0) {
+                io->write(io->cl, io->out, io->out_length);
+                io->out_length = 0;
+        }
+}
+
+/*
+*       Description: Buffers one output character.
+*
+*       In/Out Expectations: Expects a valid io_buffer and a value between
+*       0 and 255. Writes the buffer out once it holds flush_at bytes.
+*       Returns nothing.
+*/
+void io_put(io_buffer io, uint32_t c)
+{
+        io->out[io->out_length++] = (unsigned char)c;
+        if (io->out_length >= io->flush_at) {
+                io_flush(io);
+        }
+}
+
+/*
+*       Description: Gets one input character. When no input is buffered,
+*       pending output is flushed first, so a prompt is visible before the
+*       program waits for its answer, and then a whole chunk is read.
+*
+*       In/Out Expectations: Expects a valid io_buffer. Returns the next
+*       input byte, or UM_IO_EOF at end of input or on a read error. Input
+*       that isn't there yet also reads as UM_IO_EOF, as there is no way 
+*       to wait for it here; check io_blocked first to avoid that.
+*/
+uint32_t io_get(io_buffer io)
+{
+        if (io->in_pos == io->in_length) {
+                if (io->at_eof) {
+                        io->at_eof = false;
+                        return UM_IO_EOF;
+                }
+                io_flush(io);
+                size_t got = io->read(io->cl, io->in, IO_BUFFER_SIZE);
+                if (got == 0 || got == IO_WOULD_BLOCK) {
+                        return UM_IO_EOF;
+                }
+                io->in_pos = 0;
+                io->in_length = got;
+        }
+        return io->in[io->in_pos++];
+}
+
+/*
+*       Description: Checks whether an input instruction would have to wait
+*       for input that isn't there yet. When no input is buffered, pending
+*       output is flushed and the reader is asked for more, as in io_get.
+*
+*       In/Out Expectations: Expects a valid io_buffer. Returns true if the
+*       reader said IO_WOULD_BLOCK; false if a byte (or the end of input,
+*       which the next io_get returns) is ready.
+*/
+bool io_blocked(io_buffer io)
+{
+        if (io->in_pos < io->in_length || io->at_eof) {
+                return false;
+        }
+        io_flush(io);
+        size_t got = io->read(io->cl, io->in, IO_BUFFER_SIZE);
+        if (got == IO_WOULD_BLOCK) {
+                return true;
+        }
+        io->in_pos = 0;
+        io->in_length = got;
+        io->at_eof = (got == 0);
+        return false;
+}
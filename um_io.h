@@ -0,0 +1,48 @@
+/******************************************************************************
+*       um_io.h
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the declarations for the um's input/output 
+*       buffers. Output bytes are collected in a large buffer and written 
+*       with write(2) once a byte threshold is reached, before the program
+*       blocks on input, and on halt. Input is read ahead in large chunks.
+*       Buffers can also read bytes fed to them and keep output in memory,
+*       or read and write through functions the caller supplies.
+*   
+******************************************************************************/
+
+#ifndef UM_IO_
+#define UM_IO_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define UM_IO_EOF (~(uint32_t)0)
+
+/* What a reader returns when it has no input yet, but may later */
+#define IO_WOULD_BLOCK ((size_t)-1)
+
+typedef struct io_buffer *io_buffer;
+
+typedef size_t (*io_reader)(void *cl, unsigned char *bytes, size_t max);
+typedef void (*io_writer)(void *cl, const unsigned char *bytes, 
+                          size_t length);
+
+io_buffer new_io(int in_fd, int out_fd, size_t flush_at);
+io_buffer new_io_bytes(const unsigned char *input, size_t length, 
+                       bool closed);
+io_buffer new_io_callbacks(io_reader read, io_writer write, void *cl);
+void free_io(io_buffer io);
+const unsigned char *io_output(io_buffer io, size_t *length);
+void io_feed(io_buffer io, const unsigned char *input, size_t length);
+void io_close_input(io_buffer io);
+void io_put(io_buffer io, uint32_t c);
+uint32_t io_get(io_buffer io);
+bool io_blocked(io_buffer io);
+void io_flush(io_buffer io);
+
+#endif
@@ -0,0 +1,783 @@
+/******************************************************************************
+*       um_jit.c
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the implementation of the um's JIT tier. A block
+*       starts at a pc the instruction loop hands to jit_run, and runs
+*       through the following instructions the jit can translate (at most
+*       JIT_MAX_BLOCK of them), plus a load program that ends the run. It
+*       is compiled once the pc has been entered as many times as the
+*       jit's threshold (JIT_THRESHOLD for execute_jit).
+*
+*       Blocks aren't functions. The start of the code buffer holds one
+*
+*           uint64_t enter(uint32_t *reg, Um_segment *table,
+*                          uint8_t **blocks, uint32_t pc, uint32_t length,
+*                          uint64_t *budget)
+*
+*       that saves the host's registers, copies *budget to the top of the
+*       stack, loads um register i into host register r8 + i, and jumps to
+*       the dispatcher, which jumps to the block compiled at pc (eax). A
+*       block ends by putting the next pc in eax and jumping back to the
+*       dispatcher, so a chain of blocks runs with the um registers in host
+*       registers the whole way. When there is no block at pc, or a block
+*       leaves an instruction to the instruction loop, the code jumps to
+*       the exit, which stores the um registers and the budget and returns
+*       the pc. In a jit made to count (for execute_jit_budgeted), a block
+*       takes its length from the budget as it starts (or leaves at once if
+*       the budget is shorter), and a side exit gives back what it skips,
+*       so the budget is kept exactly. Bit 32 of the result is set when the
+*       instruction loop must run that pc: the instruction after a block
+*       that stops at one the jit doesn't translate, a load program from
+*       another segment, or a segmented store that the generated code
+*       leaves alone (one to a segment sharing its words).
+*
+*       Compiled programs keep their globals in segment 0, so a store
+*       there calls store_program (below) rather than exiting: it exits
+*       only if the store lands on compiled code, or made segment 0 copy
+*       its words (so the instruction loop fetches from the new copy).
+*
+*       Stores to segment 0 that land on compiled code, a load program that
+*       replaces segment 0, and a full code buffer all throw every block
+*       away. Other machines get a jit that is never available.
+*
+******************************************************************************/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+#include "memory_type.h"
+#include "um_jit.h"
+
+#if defined(__x86_64__)
+
+#include <sys/mman.h>
+
+#define JIT_CODE_BYTES (16 << 20)
+#define JIT_MAX_BLOCK 256
+/* longest translation of one instruction (a store and its exit stubs) */
+#define JIT_INSTRUCTION_BYTES 192
+#define JIT_BLOCK_BYTES (JIT_MAX_BLOCK * JIT_INSTRUCTION_BYTES + 128)
+#define JIT_INTERPRET ((uint64_t)1 << 32)
+
+/* Host register numbers, as x86-64 encodes them */
+#define RAX 0
+#define RCX 1
+#define RDX 2
+#define RBX 3
+#define RBP 5
+#define RSI 6
+#define RDI 7
+#define HOST(r) (8 + (r))
+
+/* What store_program tells the generated code to do after it returns */
+#define JIT_STORED 0
+#define JIT_STORE_EXIT 1
+#define JIT_STORED_EXIT 2
+
+typedef uint64_t (*Jit_enter)(uint32_t *reg, Um_segment *table,
+                              unsigned char **blocks, uint32_t pc,
+                              uint32_t length, uint64_t *budget);
+
+/*
+*       Description: A jit for one memory. blocks, heat and covered are
+*       indexed by segment 0 pc and have length entries: the compiled
+*       block starting at each pc (or NULL), the number of times an
+*       uncompiled pc has been entered (threshold once compiling it has
+*       been tried), and whether any block translates the instruction
+*       there. code is the executable buffer; code_used bytes of it hold
+*       enter, the dispatcher and the exit (at the addresses kept here)
+*       and then the blocks.
+*/
+struct jit {
+        memory mem;
+        uint32_t length;
+        unsigned char **blocks;
+        uint8_t *heat;
+        uint8_t *covered;
+        unsigned threshold;
+        bool counted;
+        unsigned char *code;
+        size_t code_used;
+        Jit_enter enter;
+        unsigned char *dispatch;
+        unsigned char *exit;
+};
+
+/*
+*       Description: A conditional jump out of a block, waiting to be
+*       pointed at the exit stub that returns pc to the instruction loop.
+*/
+struct side_exit {
+        unsigned char *patch;
+        uint32_t pc;
+};
+
+/*
+*       Description: Emitters for the handful of x86-64 instructions the
+*       jit uses. Each writes at *p and advances it. Registers are host
+*       register numbers; all register operations are 32 bit.
+*/
+static void emit_byte(unsigned char **p, unsigned byte)
+{
+        *(*p)++ = byte;
+}
+
+static void emit_u32(unsigned char **p, uint32_t value)
+{
+        memcpy(*p, &value, sizeof(value));
+        *p += sizeof(value);
+}
+
+static void emit_rex(unsigned char **p, int wide, int reg, int index,
+                     int base)
+{
+        unsigned rex = 0x40 | wide << 3 | (reg >> 3) << 2 |
+                       (index >> 3) << 1 | base >> 3;
+        if (rex != 0x40) {
+                emit_byte(p, rex);
+        }
+}
+
+/*
+ * A register to register instruction; opcodes above 0xff are 0x0f
+ * prefixed. reg is the ModRM reg field (a register or an opcode
+ * extension) and rm the register operand.
+ */
+static void emit_rr(unsigned char **p, unsigned opcode, int reg, int rm)
+{
+        emit_rex(p, 0, reg, 0, rm);
+        if (opcode > 0xff) {
+                emit_byte(p, opcode >> 8);
+        }
+        emit_byte(p, opcode & 0xff);
+        emit_byte(p, 0xc0 | (reg & 7) << 3 | (rm & 7));
+}
+
+static void emit_mov(unsigned char **p, int dst, int src)
+{
+        emit_rr(p, 0x89, src, dst);
+}
+
+static void emit_mov_imm(unsigned char **p, int dst, uint32_t value)
+{
+        emit_rex(p, 0, 0, 0, dst);
+        emit_byte(p, 0xb8 | (dst & 7));
+        emit_u32(p, value);
+}
+
+/* mov r, [rdi + 4 * i] and mov [rdi + 4 * i], r: um register i's slot */
+static void emit_load_reg(unsigned char **p, int r, int i)
+{
+        emit_rex(p, 0, r, 0, RDI);
+        emit_byte(p, 0x8b);
+        emit_byte(p, 0x40 | (r & 7) << 3 | RDI);
+        emit_byte(p, 4 * i);
+}
+
+static void emit_store_reg(unsigned char **p, int r, int i)
+{
+        emit_rex(p, 0, r, 0, RDI);
+        emit_byte(p, 0x89);
+        emit_byte(p, 0x40 | (r & 7) << 3 | RDI);
+        emit_byte(p, 4 * i);
+}
+
+/* rax = offset of table[seg] from rsi, for a um register holding seg */
+static void emit_entry_offset(unsigned char **p, int seg)
+{
+        emit_mov(p, RAX, seg);
+        emit_byte(p, 0x48);                     /* shl rax, 4 */
+        emit_byte(p, 0xc1);
+        emit_byte(p, 0xe0);
+        emit_byte(p, 4);
+}
+
+/* rax = table[seg].words, once rax holds table[seg]'s offset */
+static void emit_entry_words(unsigned char **p)
+{
+        emit_byte(p, 0x48);                     /* mov rax, [rsi+rax+d8] */
+        emit_byte(p, 0x8b);
+        emit_byte(p, 0x44);
+        emit_byte(p, 0x06);
+        emit_byte(p, offsetof(Um_segment, words));
+}
+
+/* op r, [rax + 4 * rcx], with op 0x8b (load) or 0x89 (store) */
+static void emit_word_access(unsigned char **p, unsigned opcode, int r)
+{
+        emit_rex(p, 0, r, 0, 0);
+        emit_byte(p, opcode);
+        emit_byte(p, 0x04 | (r & 7) << 3);
+        emit_byte(p, 0x88);
+}
+
+/* A 0x0f 0x8? conditional jump with a rel32 to be patched; returns it */
+static unsigned char *emit_jcc(unsigned char **p, unsigned condition)
+{
+        emit_byte(p, 0x0f);
+        emit_byte(p, 0x80 | condition);
+        unsigned char *patch = *p;
+        emit_u32(p, 0);
+        return patch;
+}
+
+static void patch_jump(unsigned char *patch, unsigned char *target)
+{
+        int32_t rel = target - (patch + 4);
+        memcpy(patch, &rel, sizeof(rel));
+}
+
+/* A jmp rel32 to a known target */
+static void emit_jmp(unsigned char **p, unsigned char *target)
+{
+        emit_byte(p, 0xe9);
+        unsigned char *patch = *p;
+        emit_u32(p, 0);
+        patch_jump(patch, target);
+}
+
+/* mov rax, imm64 */
+static void emit_mov_imm64(unsigned char **p, uint64_t value)
+{
+        emit_byte(p, 0x48);
+        emit_byte(p, 0xb8);
+        memcpy(*p, &value, sizeof(value));
+        *p += sizeof(value);
+}
+
+/* op qword [rsp], imm32 on the budget, with ext 0 (add), 5 (sub), 7 (cmp) */
+static void emit_budget_op(unsigned char **p, int ext, uint32_t value)
+{
+        emit_byte(p, 0x48);
+        emit_byte(p, 0x81);
+        emit_byte(p, 0x04 | ext << 3);
+        emit_byte(p, 0x24);
+        emit_u32(p, value);
+}
+
+#define JCC_B  0x2
+#define JCC_AE 0x3
+#define JCC_E  0x4
+#define JCC_NE 0x5
+#define JCC_A  0x7
+
+/*
+*       Description: Does a store to segment 0 for generated code, as the
+*       instruction loop would, unless the word is compiled code.
+*
+*       In/Out Expectations: Expects a jit, the index and the word. Returns
+*       JIT_STORE_EXIT without storing if the word is in a block (so the
+*       instruction loop stores it and throws the blocks away),
+*       JIT_STORED_EXIT if the store made segment 0 copy its words, and
+*       JIT_STORED otherwise.
+*/
+static uint32_t store_program(jit j, uint32_t index, uint32_t word)
+{
+        if (index < j->length && j->covered[index]) {
+                return JIT_STORE_EXIT;
+        }
+        return set_word(j->mem, 0, index, word) ? JIT_STORED_EXIT :
+                                                  JIT_STORED;
+}
+
+/*
+*       Description: Emits a call to store_program for the store of um
+*       register c to index b of segment 0, and the exits after it.
+*
+*       In/Out Expectations: Expects the write position, the jit, the host
+*       registers holding the index and word, the store's pc, and the
+*       block's side exit list with its count. Returns nothing.
+*/
+static void emit_store_program(unsigned char **p, jit j, int b, int c,
+                               uint32_t pc, struct side_exit *exits,
+                               int *num_exits)
+{
+        /* save rdi, rsi and r8-r11, which the call may clobber, keeping
+           the stack 16 byte aligned */
+        emit_byte(p, 0x57);                             /* push rdi */
+        emit_byte(p, 0x56);                             /* push rsi */
+        for (int i = 0; i < 4; i++) {                   /* push r8-r11 */
+                emit_rex(p, 0, 0, 0, HOST(i));
+                emit_byte(p, 0x50 | (HOST(i) & 7));
+        }
+        emit_byte(p, 0x48);                             /* sub rsp, 8 */
+        emit_byte(p, 0x83);
+        emit_byte(p, 0xec);
+        emit_byte(p, 8);
+
+        emit_mov(p, RSI, b);
+        emit_mov(p, RDX, c);
+        emit_byte(p, 0x48);                             /* mov rdi, j */
+        emit_byte(p, 0xbf);
+        memcpy(*p, &j, sizeof(j));
+        *p += sizeof(j);
+        uint32_t (*helper)(jit, uint32_t, uint32_t) = store_program;
+        uint64_t address;
+        memcpy(&address, &helper, sizeof(address));
+        emit_mov_imm64(p, address);
+        emit_rr(p, 0xff, 2, RAX);                       /* call rax */
+
+        emit_byte(p, 0x48);                             /* add rsp, 8 */
+        emit_byte(p, 0x83);
+        emit_byte(p, 0xc4);
+        emit_byte(p, 8);
+        for (int i = 3; i >= 0; i--) {                  /* pop r11-r8 */
+                emit_rex(p, 0, 0, 0, HOST(i));
+                emit_byte(p, 0x58 | (HOST(i) & 7));
+        }
+        emit_byte(p, 0x5e);                             /* pop rsi */
+        emit_byte(p, 0x5f);                             /* pop rdi */
+
+        emit_byte(p, 0x83);                             /* cmp eax, 1 */
+        emit_byte(p, 0xf8);
+        emit_byte(p, JIT_STORE_EXIT);
+        exits[*num_exits].patch = emit_jcc(p, JCC_E);
+        exits[(*num_exits)++].pc = pc;
+        exits[*num_exits].patch = emit_jcc(p, JCC_A);
+        exits[(*num_exits)++].pc = pc + 1;
+}
+
+/*
+*       Description: Reports whether the jit translates an opcode inside a
+*       block.
+*/
+static bool translatable(unsigned opcode)
+{
+        switch (opcode) {
+        case CMOV: case SLOAD: case SSTORE: case ADD: case MUL: case DIV:
+        case NAND: case LOADV:
+                return true;
+        default:
+                return false;
+        }
+}
+
+/*
+*       Description: Emits the translation of one instruction.
+*
+*       In/Out Expectations: Expects the write position, the jit, the
+*       decoded instruction at pc, and the block's side exit list with its
+*       count. Appends side exits for a segmented store. Returns nothing.
+*/
+static void emit_instruction(unsigned char **p, jit j, Um_decoded ins,
+                             uint32_t pc, struct side_exit *exits,
+                             int *num_exits)
+{
+        int a = HOST(ins.ra);
+        int b = HOST(ins.rb);
+        int c = HOST(ins.rc);
+
+        switch (ins.opcode) {
+        case CMOV:
+                emit_rr(p, 0x85, c, c);                 /* test c, c */
+                emit_rr(p, 0x0f45, a, b);               /* cmovne a, b */
+                break;
+        case SLOAD:
+                emit_entry_offset(p, b);
+                emit_entry_words(p);
+                emit_mov(p, RCX, c);
+                emit_word_access(p, 0x8b, a);
+                break;
+        case SSTORE: {
+                emit_rr(p, 0x85, a, a);                 /* test a, a */
+                unsigned char *other = emit_jcc(p, JCC_NE);
+                emit_store_program(p, j, b, c, pc, exits, num_exits);
+                emit_byte(p, 0xe9);                     /* jmp done */
+                unsigned char *done = *p;
+                emit_u32(p, 0);
+                patch_jump(other, *p);
+                emit_entry_offset(p, a);
+                emit_byte(p, 0x83);                     /* cmp share, 0 */
+                emit_byte(p, 0x7c);
+                emit_byte(p, 0x06);
+                emit_byte(p, offsetof(Um_segment, share));
+                emit_byte(p, NO_SHARE);
+                exits[*num_exits].patch = emit_jcc(p, JCC_NE);
+                exits[(*num_exits)++].pc = pc;
+                emit_entry_words(p);
+                emit_mov(p, RCX, b);
+                emit_word_access(p, 0x89, c);
+                patch_jump(done, *p);
+                break;
+        }
+        case ADD:
+                emit_mov(p, RAX, b);
+                emit_rr(p, 0x01, c, RAX);               /* add eax, c */
+                emit_mov(p, a, RAX);
+                break;
+        case MUL:
+                emit_mov(p, RAX, b);
+                emit_rr(p, 0x0faf, RAX, c);             /* imul eax, c */
+                emit_mov(p, a, RAX);
+                break;
+        case DIV:
+                emit_mov(p, RAX, b);
+                emit_rr(p, 0x31, RDX, RDX);             /* xor edx, edx */
+                emit_rr(p, 0xf7, 6, c);                 /* div c */
+                emit_mov(p, a, RAX);
+                break;
+        case NAND:
+                emit_mov(p, RAX, b);
+                emit_rr(p, 0x21, c, RAX);               /* and eax, c */
+                emit_rr(p, 0xf7, 2, RAX);               /* not eax */
+                emit_mov(p, a, RAX);
+                break;
+        case LOADV:
+                emit_mov_imm(p, a, ins.value);
+                break;
+        default:
+                assert(0);
+        }
+}
+
+/*
+*       Description: Writes enter, the dispatcher and the exit at the start
+*       of the code buffer (see the top of this file).
+*
+*       In/Out Expectations: Expects a jit whose code buffer is writable
+*       and empty. Sets code_used past them. Returns nothing.
+*/
+static void emit_trampoline(jit j)
+{
+        unsigned char *p = j->code;
+        unsigned char *enter = p;
+        emit_byte(&p, 0x53);                            /* push rbx */
+        emit_byte(&p, 0x55);                            /* push rbp */
+        for (int i = 4; i < 8; i++) {                   /* push r12-r15 */
+                emit_rex(&p, 0, 0, 0, HOST(i));
+                emit_byte(&p, 0x50 | (HOST(i) & 7));
+        }
+        emit_byte(&p, 0x41);                            /* push r9 */
+        emit_byte(&p, 0x51);
+        emit_byte(&p, 0x41);                            /* push qword [r9] */
+        emit_byte(&p, 0xff);
+        emit_byte(&p, 0x31);
+        emit_byte(&p, 0x48);                            /* mov rbx, rdx */
+        emit_mov(&p, RBX, RDX);
+        emit_mov(&p, RBP, HOST(0));                     /* mov ebp, r8d */
+        emit_mov(&p, RAX, RCX);                         /* mov eax, ecx */
+        for (int i = 0; i < 8; i++) {
+                emit_load_reg(&p, HOST(i), i);
+        }
+
+        j->dispatch = p;
+        emit_rr(&p, 0x39, RBP, RAX);                    /* cmp eax, ebp */
+        unsigned char *past_end = emit_jcc(&p, JCC_AE);
+        emit_byte(&p, 0x48);                            /* mov rdx, */
+        emit_byte(&p, 0x8b);                            /* [rbx + 8 * rax] */
+        emit_byte(&p, 0x14);
+        emit_byte(&p, 0xc3);
+        emit_byte(&p, 0x48);                            /* test rdx, rdx */
+        emit_rr(&p, 0x85, RDX, RDX);
+        unsigned char *no_block = emit_jcc(&p, JCC_E);
+        emit_rr(&p, 0xff, 4, RDX);                      /* jmp rdx */
+
+        j->exit = p;
+        patch_jump(past_end, p);
+        patch_jump(no_block, p);
+        for (int i = 0; i < 8; i++) {
+                emit_store_reg(&p, HOST(i), i);
+        }
+        emit_byte(&p, 0x59);                            /* pop rcx */
+        emit_byte(&p, 0x5a);                            /* pop rdx */
+        emit_byte(&p, 0x48);                            /* mov [rdx], rcx */
+        emit_byte(&p, 0x89);
+        emit_byte(&p, 0x0a);
+        for (int i = 7; i >= 4; i--) {                  /* pop r15-r12 */
+                emit_rex(&p, 0, 0, 0, HOST(i));
+                emit_byte(&p, 0x58 | (HOST(i) & 7));
+        }
+        emit_byte(&p, 0x5d);                            /* pop rbp */
+        emit_byte(&p, 0x5b);                            /* pop rbx */
+        emit_byte(&p, 0xc3);                            /* ret */
+
+        memcpy(&j->enter, &enter, sizeof(enter));
+        j->code_used = p - j->code;
+}
+
+/*
+*       Description: Throws away every block and sizes the tables for the
+*       current segment 0.
+*
+*       In/Out Expectations: Expects a jit. Returns nothing.
+*/
+static void clear_blocks(jit j)
+{
+        free(j->blocks);
+        free(j->heat);
+        free(j->covered);
+        j->length = segment_table(j->mem)[0].length;
+        size_t entries = j->length > 0 ? j->length : 1;
+        j->blocks = calloc(entries, sizeof(*j->blocks));
+        j->heat = calloc(entries, sizeof(*j->heat));
+        j->covered = calloc(entries, sizeof(*j->covered));
+        assert(j->blocks != NULL && j->heat != NULL && j->covered != NULL);
+
+        int writable = mprotect(j->code, JIT_CODE_BYTES,
+                                PROT_READ | PROT_WRITE);
+        assert(writable == 0);
+        emit_trampoline(j);
+        int protected = mprotect(j->code, JIT_CODE_BYTES,
+                                 PROT_READ | PROT_EXEC);
+        assert(protected == 0);
+        __builtin___clear_cache((char *)j->code,
+                                (char *)j->code + j->code_used);
+}
+
+/*
+*       Description: Compiles the block starting at pc.
+*
+*       In/Out Expectations: Expects a jit and a pc inside segment 0.
+*       Returns the compiled block, or NULL if the instruction at pc can't
+*       start one.
+*/
+static unsigned char *compile_block(jit j, uint32_t pc)
+{
+        const uint32_t *words = get_segment(j->mem, 0);
+        Um_decoded program[JIT_MAX_BLOCK + 1];
+        int count = 0;
+
+        while (count < JIT_MAX_BLOCK && pc + count < j->length) {
+                Um_decoded ins = decode_instruction(words[pc + count]);
+                if (!translatable(ins.opcode) && ins.opcode != LOADP) {
+                        break;
+                }
+                program[count++] = ins;
+                if (ins.opcode == LOADP) {
+                        break;
+                }
+        }
+        if (count == 0) {
+                return NULL;
+        }
+
+        if (j->code_used + JIT_BLOCK_BYTES > JIT_CODE_BYTES) {
+                clear_blocks(j);
+        }
+        if (mprotect(j->code, JIT_CODE_BYTES, PROT_READ | PROT_WRITE) != 0) {
+                return NULL;
+        }
+
+        unsigned char *start = j->code + j->code_used;
+        unsigned char *p = start;
+        struct side_exit exits[3 * JIT_MAX_BLOCK + 1];
+        int num_exits = 0;
+
+        unsigned char *short_budget = NULL;
+        if (j->counted) {
+                emit_budget_op(&p, 7, count);           /* cmp budget */
+                short_budget = emit_jcc(&p, JCC_B);
+                emit_budget_op(&p, 5, count);           /* sub budget */
+        }
+
+        for (int i = 0; i < count; i++) {
+                Um_decoded ins = program[i];
+                if (ins.opcode != LOADP) {
+                        emit_instruction(&p, j, ins, pc + i, exits,
+                                         &num_exits);
+                        continue;
+                }
+                /* a jump within segment 0 chains; anything else exits */
+                emit_rr(&p, 0x85, HOST(ins.rb), HOST(ins.rb));
+                exits[num_exits].patch = emit_jcc(&p, JCC_NE);
+                exits[num_exits++].pc = pc + i;
+                emit_mov(&p, RAX, HOST(ins.rc));
+                emit_jmp(&p, j->dispatch);
+        }
+        if (program[count - 1].opcode != LOADP) {
+                uint32_t next = pc + count;
+                if (next < j->length && count < JIT_MAX_BLOCK) {
+                        /* stopped at an instruction only the loop runs */
+                        emit_mov_imm64(&p, next | JIT_INTERPRET);
+                        emit_jmp(&p, j->exit);
+                } else {
+                        emit_mov_imm(&p, RAX, next);
+                        emit_jmp(&p, j->dispatch);
+                }
+        }
+
+        if (j->counted) {
+                patch_jump(short_budget, p);
+                emit_mov_imm64(&p, pc | JIT_INTERPRET);
+                emit_jmp(&p, j->exit);
+        }
+
+        /* one stub per pc, shared by a store's two exits, giving back the
+           budget of the instructions from there on */
+        unsigned char *stub = NULL;
+        for (int i = 0; i < num_exits; i++) {
+                if (i == 0 || exits[i].pc != exits[i - 1].pc) {
+                        stub = p;
+                        if (j->counted && exits[i].pc < pc + count) {
+                                emit_budget_op(&p, 0,
+                                               pc + count - exits[i].pc);
+                        }
+                        emit_mov_imm64(&p, exits[i].pc | JIT_INTERPRET);
+                        emit_jmp(&p, j->exit);
+                }
+                patch_jump(exits[i].patch, stub);
+        }
+        assert((size_t)(p - start) <= JIT_BLOCK_BYTES);
+
+        int protected = mprotect(j->code, JIT_CODE_BYTES, 
+                                 PROT_READ | PROT_EXEC);
+        assert(protected == 0);
+        __builtin___clear_cache((char *)start, (char *)p);
+        j->code_used += p - start;
+
+        memset(&j->covered[pc], 1, count);
+        j->blocks[pc] = start;
+        return start;
+}
+
+/*
+*       Description: Creates a jit for a memory whose segment 0 holds the
+*       program to run.
+*
+*       In/Out Expectations: Expects a valid memory type, the number of
+*       times (1 to 255) a pc must be entered before its block is compiled,
+*       and whether its blocks count against a budget (which jit_run may
+*       only be given if they do). Returns a new jit, to be freed with
+*       free_jit, or NULL if no executable buffer can be had.
+*/
+jit new_jit(memory mem, unsigned threshold, bool counted)
+{
+        assert(threshold >= 1 && threshold <= UINT8_MAX);
+        assert(sizeof(Um_segment) == 16);
+        jit j = malloc(sizeof(*j));
+        assert(j != NULL);
+        j->code = mmap(NULL, JIT_CODE_BYTES, PROT_READ | PROT_EXEC,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (j->code == MAP_FAILED) {
+                free(j);
+                return NULL;
+        }
+        j->mem = mem;
+        j->threshold = threshold;
+        j->counted = counted;
+        j->code_used = 0;
+        j->blocks = NULL;
+        j->heat = NULL;
+        j->covered = NULL;
+        clear_blocks(j);
+        return j;
+}
+
+/*
+*       Description: Frees a jit and its code.
+*
+*       In/Out Expectations: Expects a jit from new_jit. Returns nothing.
+*/
+void free_jit(jit j)
+{
+        munmap(j->code, JIT_CODE_BYTES);
+        free(j->blocks);
+        free(j->heat);
+        free(j->covered);
+        free(j);
+}
+
+/*
+*       Description: Runs compiled code from pc for as long as it can:
+*       block to block, compiling blocks as their pcs get hot. Blocks that
+*       are already compiled chain without coming back here.
+*
+*       In/Out Expectations: Expects a jit, the instruction loop's
+*       registers, the pc it is about to execute, and the number of
+*       instructions that may be run (NULL for no limit), which is left
+*       with the number not run. Returns the pc the instruction loop
+*       should execute next, with the registers updated.
+*/
+uint32_t jit_run(jit j, uint32_t *reg, uint32_t pc, uint64_t *budget)
+{
+        assert(budget == NULL || j->counted);
+        uint64_t unlimited = UINT64_MAX;
+        if (budget == NULL) {
+                budget = &unlimited;
+        }
+        for (;;) {
+                if (pc >= j->length) {
+                        return pc;
+                }
+                if (j->blocks[pc] == NULL) {
+                        if (j->heat[pc] >= j->threshold ||
+                            ++j->heat[pc] < j->threshold ||
+                            compile_block(j, pc) == NULL) {
+                                return pc;
+                        }
+                }
+                uint64_t result = j->enter(reg, segment_table(j->mem),
+                                           j->blocks, pc, j->length,
+                                           budget);
+                pc = (uint32_t)result;
+                if (result & JIT_INTERPRET) {
+                        return pc;
+                }
+        }
+}
+
+/*
+*       Description: Tells the jit about a store to segment 0.
+*
+*       In/Out Expectations: Expects a jit and the index stored to. Throws
+*       every block away if the word was compiled. Returns nothing.
+*/
+void jit_store(jit j, uint32_t index)
+{
+        if (index < j->length && j->covered[index]) {
+                clear_blocks(j);
+        }
+}
+
+/*
+*       Description: Tells the jit segment 0 has been replaced.
+*
+*       In/Out Expectations: Expects a jit. Returns nothing.
+*/
+void jit_reset(jit j)
+{
+        clear_blocks(j);
+}
+
+#else
+
+jit new_jit(memory mem, unsigned threshold, bool counted)
+{
+        (void)mem;
+        (void)threshold;
+        (void)counted;
+        return NULL;
+}
+
+void free_jit(jit j)
+{
+        (void)j;
+}
+
+uint32_t jit_run(jit j, uint32_t *reg, uint32_t pc, uint64_t *budget)
+{
+        (void)j;
+        (void)reg;
+        (void)budget;
+        return pc;
+}
+
+void jit_store(jit j, uint32_t index)
+{
+        (void)j;
+        (void)index;
+}
+
+void jit_reset(jit j)
+{
+        (void)j;
+}
+
+#endif
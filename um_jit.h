@@ -0,0 +1,36 @@
+/******************************************************************************
+*       um_jit.h
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the declarations for the um's optional JIT tier.
+*       Hot straight-line runs of segment 0 (the register, arithmetic,
+*       load value, segmented load and segmented store instructions, up to
+*       the next instruction that isn't one of those) are translated to
+*       x86-64 code with the eight um registers pinned to host registers.
+*       The instruction loop hands the jit a pc wherever a run may begin,
+*       and executes everything the generated code doesn't.
+*
+******************************************************************************/
+
+#ifndef UM_JIT_
+#define UM_JIT_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "memory_type.h"
+
+typedef struct jit *jit;
+
+/* How many times execute_jit lets a pc be entered before compiling it */
+#define JIT_THRESHOLD 8
+
+jit new_jit(memory mem, unsigned threshold, bool counted);
+void free_jit(jit j);
+uint32_t jit_run(jit j, uint32_t *reg, uint32_t pc, uint64_t *budget);
+void jit_store(jit j, uint32_t index);
+void jit_reset(jit j);
+
+#endif
@@ -0,0 +1,267 @@
+/******************************************************************************
+*       um_machine.c
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the implementation of um machines. A machine
+*       owns its memory, registers, and an io_buffer (over byte arrays or
+*       the host's callbacks), so nothing it does is shared with another 
+*       machine except the word arrays fork_memory shares copy-on-write.
+*       Its pc is kept between runs, so a run cut short by an instruction
+*       budget or a wait for input can be carried on later.
+*
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "um_machine.h"
+#include "um_operations.h"
+#include "um_populate.h"
+#include "um_io.h"
+
+struct um_machine {
+        memory mem;
+        uint32_t registers[8];
+        uint32_t pc;
+        bool halted;
+        io_buffer io;
+};
+
+/*
+*       Description: Makes a machine around a memory, with the given
+*       registers and pc, and no input yet (but more can be fed).
+*
+*       In/Out Expectations: Expects a memory the machine takes over, eight
+*       registers to copy, and a pc. Returns the new machine.
+*/
+static um_machine make_machine(memory mem, const uint32_t *registers,
+                               uint32_t pc)
+{
+        um_machine m = malloc(sizeof(*m));
+        assert(m != NULL);
+        m->mem = mem;
+        for (int i = 0; i < 8; i++) {
+                m->registers[i] = registers[i];
+        }
+        m->pc = pc;
+        m->halted = false;
+        m->io = new_io_bytes(NULL, 0, false);
+        return m;
+}
+
+/*
+*       Description: Makes a machine ready to run the program in a .um
+*       file, with all registers 0 and no input yet.
+*
+*       In/Out Expectations: Expects the program's file name. Returns the
+*       machine, to be freed with um_machine_free, or NULL if the file
+*       can't be opened or read or isn't a whole number of 32 bit words.
+*/
+um_machine um_machine_new(const char *filename)
+{
+        FILE *fp = fopen(filename, "r");
+        if (fp == NULL) {
+                return NULL;
+        }
+        memory mem = new_memory();
+        bool ok = populate_instructions(fp, mem);
+        fclose(fp);
+        if (!ok) {
+                free_memory(mem);
+                return NULL;
+        }
+
+        uint32_t registers[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        return make_machine(mem, registers, 0);
+}
+
+/*
+*       Description: Makes a machine ready to run a program held in memory,
+*       with all registers 0 and no input yet.
+*
+*       In/Out Expectations: Expects the program as the bytes of a .um file
+*       (big-endian words) and their number; the bytes are copied. Returns
+*       the machine, to be freed with um_machine_free, or NULL if length 
+*       isn't a multiple of 4.
+*/
+um_machine um_machine_new_bytes(const unsigned char *program, size_t length)
+{
+        memory mem = new_memory();
+        if (!populate_bytes(program, length, mem)) {
+                free_memory(mem);
+                return NULL;
+        }
+
+        uint32_t registers[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        return make_machine(mem, registers, 0);
+}
+
+/*
+*       Description: Makes a copy of a machine that hasn't run yet or has
+*       stopped, sharing its memory copy-on-write (see fork_memory).
+*
+*       In/Out Expectations: Expects a machine that isn't running; several
+*       forks of one machine must not be made at the same time. Returns
+*       the copy, with the same registers and pc but no input or output
+*       (the original keeps those), to be freed with um_machine_free. The 
+*       two can then run on different threads.
+*/
+um_machine um_machine_fork(um_machine m)
+{
+        um_machine copy = make_machine(fork_memory(m->mem), m->registers, 
+                                       m->pc);
+        copy->halted = m->halted;
+        return copy;
+}
+
+/*
+*       Description: Frees a machine, its memory, and its output.
+*
+*       In/Out Expectations: Expects a machine that isn't running. Returns
+*       nothing.
+*/
+void um_machine_free(um_machine m)
+{
+        free_io(m->io);
+        free_memory(m->mem);
+        free(m);
+}
+
+/*
+*       Description: Gives a machine all the bytes its input instructions 
+*       will read, replacing any it had.
+*
+*       In/Out Expectations: Expects a machine that isn't running, and the
+*       input (NULL for none) and its length, which are copied. After the 
+*       bytes, input reads as end of file. Output collected so far is 
+*       dropped. Returns nothing.
+*/
+void um_machine_set_input(um_machine m, const unsigned char *input,
+                          size_t length)
+{
+        free_io(m->io);
+        m->io = new_io_bytes(input, length, true);
+}
+
+/*
+*       Description: Adds input for a machine to read after what it has, 
+*       e.g. as it arrives for a machine that stopped with UM_BLOCKED.
+*
+*       In/Out Expectations: Expects a machine that isn't running and 
+*       hasn't had set_input, set_callbacks or close_input, and the bytes,
+*       which are copied. Returns nothing.
+*/
+void um_machine_feed(um_machine m, const unsigned char *input, size_t length)
+{
+        io_feed(m->io, input, length);
+}
+
+/*
+*       Description: Says no more input will be fed to a machine, so once
+*       it has read what it was given, input reads as end of file instead
+*       of blocking.
+*
+*       In/Out Expectations: Expects a machine that isn't running and 
+*       hasn't had set_callbacks. Returns nothing.
+*/
+void um_machine_close_input(um_machine m)
+{
+        io_close_input(m->io);
+}
+
+/*
+*       Description: Makes a machine get its input from, and hand its output
+*       to, functions of the host's instead of byte arrays.
+*
+*       In/Out Expectations: Expects a machine that isn't running, and a 
+*       reader, writer and closure as new_io_callbacks takes them. Output 
+*       collected so far is dropped, and um_machine_output has nothing to 
+*       return afterwards. Returns nothing.
+*/
+void um_machine_set_callbacks(um_machine m, io_reader read, io_writer write,
+                              void *cl)
+{
+        free_io(m->io);
+        m->io = new_io_callbacks(read, write, cl);
+}
+
+/*
+*       Description: Runs a machine's program until it halts.
+*
+*       In/Out Expectations: Expects a machine. Input that hasn't been fed
+*       (or that the host's reader doesn't have yet) reads as end of file.
+*       Does nothing if the machine has halted already. Returns nothing; 
+*       the output can then be got with um_machine_output.
+*/
+void um_machine_run(um_machine m)
+{
+        if (!m->halted) {
+                execute_from(m->mem, m->registers, m->pc, m->io);
+                m->halted = true;
+        }
+}
+
+/*
+*       Description: Runs a machine's program for at most a number of 
+*       instructions, or until it needs input that isn't there yet, so a 
+*       host can interleave many machines on one thread and bound how long
+*       each holds it. Everything the machine needs to carry on is kept in
+*       it between calls.
+*
+*       In/Out Expectations: Expects a machine and a budget. Output is 
+*       handed over (or collected) before this returns. Returns UM_HALTED
+*       once the machine has halted; UM_OUT_OF_BUDGET if the budget ran 
+*       out; or UM_BLOCKED if it is waiting at an input instruction for 
+*       input to be fed (or for the host's reader to have some). Call 
+*       again to carry on where it stopped.
+*/
+Um_status um_machine_run_for(um_machine m, uint64_t budget)
+{
+        if (m->halted) {
+                return UM_HALTED;
+        }
+        Um_status status = execute_budgeted(m->mem, m->registers, &m->pc,
+                                            m->io, &budget);
+        m->halted = (status == UM_HALTED);
+        return status;
+}
+
+/*
+*       Description: Runs a machine's program until it halts, like 
+*       um_machine_run, but with every instruction checked first (see 
+*       execute_checked), so a faulty program stops with a description of
+*       the fault instead of undefined behavior.
+*
+*       In/Out Expectations: Expects a machine and a fault to fill in. 
+*       Returns UM_HALTED once the machine has halted, or UM_FAULTED with 
+*       the fault filled in and the machine stopped at the faulting 
+*       instruction.
+*/
+Um_status um_machine_run_checked(um_machine m, Um_fault *fault)
+{
+        if (m->halted) {
+                fault->kind = UM_FAULT_NONE;
+                return UM_HALTED;
+        }
+        Um_status status = execute_checked(m->mem, m->registers, &m->pc,
+                                           m->io, fault);
+        m->halted = (status == UM_HALTED);
+        return status;
+}
+
+/*
+*       Description: Gets everything a machine has output.
+*
+*       In/Out Expectations: Expects a machine and a pointer to store the
+*       number of bytes in. Returns the bytes (NULL if there are none),
+*       which belong to the machine and are good until it runs again or is
+*       freed.
+*/
+const unsigned char *um_machine_output(um_machine m, size_t *length)
+{
+        return io_output(m->io, length);
+}
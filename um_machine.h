@@ -0,0 +1,46 @@
+/******************************************************************************
+*       um_machine.h
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the declarations for um machines: a memory, its
+*       registers and program counter, and its input and output,
+*       bundled so that a program can run without touching stdin or stdout
+*       and many machines can run at once on different threads, or be 
+*       embedded in a host program (libum) and run a slice at a time. The
+*       functions here (marked UM_API) are all libum.so exports.
+*
+******************************************************************************/
+
+#ifndef UM_MACHINE_
+#define UM_MACHINE_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "memory_type.h"
+#include "um_io.h"
+#include "um_operations.h"
+
+typedef struct um_machine *um_machine;
+
+UM_API um_machine um_machine_new(const char *filename);
+UM_API um_machine um_machine_new_bytes(const unsigned char *program,
+                                      size_t length);
+UM_API um_machine um_machine_fork(um_machine m);
+UM_API void um_machine_free(um_machine m);
+UM_API void um_machine_set_input(um_machine m, const unsigned char *input,
+                                 size_t length);
+UM_API void um_machine_feed(um_machine m, const unsigned char *input,
+                            size_t length);
+UM_API void um_machine_close_input(um_machine m);
+UM_API void um_machine_set_callbacks(um_machine m, io_reader read,
+                                     io_writer write, void *cl);
+UM_API void um_machine_run(um_machine m);
+UM_API Um_status um_machine_run_for(um_machine m, uint64_t budget);
+UM_API Um_status um_machine_run_checked(um_machine m, Um_fault *fault);
+UM_API const unsigned char *um_machine_output(um_machine m, size_t *length);
+
+#endif
@@ -14,22 +14,19 @@
 
 #include <stdio.h>
 #include <stdbool.h>
-#include "assert.h"
-#include "seq.h"
+#include <assert.h>
 #include "memory_type.h"
 #include "um_operations.h"
-#include "bitpack.h"
+#include "um_io.h"
+#include "um_profile.h"
+#include "um_jit.h"
+#include "um_trace.h"
+#include "um_bitpack.h"
 #include <inttypes.h>
 
 #define MAX_VAL 255
-#define MIN_VAL 0
 #define MOD_VAL 4294967296 /* equals 2^32 because using uint32_t */
 
-typedef enum Um_opcode {
-        CMOV = 0, SLOAD, SSTORE, ADD, MUL, DIV,
-        NAND, HALT, MAP, UNMAP, OUT, IN, LOADP, LOADV
-} Um_opcode;
-
 /*
 *       Description: Stores the memory and registers, and
 *       all possible values that may be used for an operation
@@ -41,6 +38,7 @@ typedef enum Um_opcode {
 struct operation_info {
         uint32_t *registers;
         memory mem;
+        io_buffer io;
         uint32_t ra;
         uint32_t rb;
         uint32_t rc;
@@ -49,91 +47,459 @@ struct operation_info {
 };
 
 
+/*
+*       Dispatch selection: GCC and clang support labels as values, which
+*       lets every handler jump straight to the next handler through a
+*       table ("direct threading"). Each opcode then gets its own indirect
+*       branch, which the branch predictor tracks separately. Building with
+*       -DUM_SWITCH_DISPATCH (make DISPATCH=switch) selects the portable
+*       switch loop instead.
+*/
+#if defined(__GNUC__) && !defined(UM_SWITCH_DISPATCH)
+#define UM_THREADED 1
+#else
+#define UM_THREADED 0
+#endif
+
+/*
+*       Instruction fetch: by default the loop runs over the pre-decoded 
+*       copy of segment 0 kept by memory_type, so fields are plain byte
+*       loads, and common pairs arrive fused into superinstructions 
+*       (UM_FUSED; RA1..RC2 get the fields of each half). Building with
+*       -DUM_NO_PREDECODE (make PREDECODE=no) runs over the raw words
+*       instead, decoding fields with inline shifts.
+*/
+#ifndef UM_NO_PREDECODE
+typedef const Um_decoded *Um_program;
+typedef const Um_decoded *Um_fetched;
+#define PROGRAM(mem)    get_decoded(mem)
+#define FETCH(program, pc) (&(program)[(pc)])
+#define OPCODE(ins)     ((ins)->opcode)
+#define RA(ins)         ((ins)->ra)
+#define RB(ins)         ((ins)->rb)
+#define RC(ins)         ((ins)->rc)
+#define RA_LOAD(ins)    ((ins)->ra)
+#define LOAD_VAL(ins)   ((ins)->value)
+#define UM_FUSED        1
+#define RA1(ins)        ((ins)->ra & 0x7)
+#define RB1(ins)        ((ins)->rb & 0x7)
+#define RC1(ins)        ((ins)->rc & 0x7)
+#define RA2(ins)        ((ins)->ra >> 3)
+#define RB2(ins)        ((ins)->rb >> 3)
+#define RC2(ins)        ((ins)->rc >> 3)
+#else
+typedef const uint32_t *Um_program;
+typedef uint32_t Um_fetched;
+#define PROGRAM(mem)    get_segment(mem, 0)
+#define FETCH(program, pc) ((program)[(pc)])
+#define OPCODE(ins)     ((ins) >> 28)
+#define RA(ins)         (((ins) >> 6) & 0x7)
+#define RB(ins)         (((ins) >> 3) & 0x7)
+#define RC(ins)         ((ins) & 0x7)
+#define RA_LOAD(ins)    (((ins) >> 25) & 0x7)
+#define LOAD_VAL(ins)   ((ins) & 0x1ffffff)
+#define UM_FUSED        0
+#endif
+
+#if UM_THREADED
+#define OP(name)        op_##name
+#define NEXT            do { ENGINE_GUARD();                            \
+                             ins = FETCH(program, pc++);                \
+                             ENGINE_STEP();                             \
+                             goto *dispatch_table[OPCODE(ins)]; } while (0)
+#else
+#define OP(name)        case name
+#define NEXT            continue
+#endif
+
+/* The plain instruction loop, one that feeds a profile, one that runs the
+ * jit's blocks, one that stops at the first input, one that stops at the
+ * end of an instruction budget, one that does both of the jit's and the
+ * budget's, one that checks for faults, and one that feeds a trace */
+#define ENGINE_NAME run_fast
+#include "um_engine.h"
+
+#define ENGINE_NAME run_profiled
+#define ENGINE_PROFILE 1
+#include "um_engine.h"
+
+#define ENGINE_NAME run_jit
+#define ENGINE_JIT 1
+#include "um_engine.h"
+
+#define ENGINE_NAME run_until_input
+#define ENGINE_SUSPEND 1
+#include "um_engine.h"
+
+#define ENGINE_NAME run_budgeted
+#define ENGINE_BUDGET 1
+#include "um_engine.h"
+
+#define ENGINE_NAME run_jit_budgeted
+#define ENGINE_JIT 1
+#define ENGINE_BUDGET 1
+#include "um_engine.h"
+
+#define ENGINE_NAME run_checked
+#define ENGINE_CHECKED 1
+#include "um_engine.h"
+
+#define ENGINE_NAME run_traced
+#define ENGINE_TRACE 1
+#include "um_engine.h"
+
+#undef OP
+#undef NEXT
+
 /*
 *       Description: Gets instructions from memory, and iterates 
-*       through/performs all instructions.
+*       through/performs all instructions, using the fast loop in 
+*       um_engine.h.
 *
-*       In/Out Expectations: Expects a valid memory type, and a pointer
-*       to the array of registers. Expects that the first segment in memory
+*       In/Out Expectations: Expects a valid memory type, a pointer
+*       to the array of registers, and the io_buffer to do input and output
+*       through. Expects that the first segment in memory
 *       is populated with the instructions from the file. Uses type from 
-*       module memory_type. Returns nothing.
+*       module memory_type. Copies the final register values back into r
+*       and flushes output on halt. Returns nothing.
+*/
+void execute_program(memory mem, uint32_t *r, io_buffer io)
+{
+        execute_from(mem, r, 0, io);
+}
+
+/*
+*       Description: Runs the program like execute_program, starting at 
+*       the given pc (e.g. that of a restored snapshot) instead of 0.
+*
+*       In/Out Expectations: Same as execute_program, plus the pc in 
+*       segment 0 to start at. Returns nothing.
+*/
+void execute_from(memory mem, uint32_t *r, uint32_t pc, io_buffer io)
+{
+        run_fast(mem, r, &pc, io, NULL, NULL, NULL, NULL, NULL);
+}
+
+/*
+*       Description: Runs the program like execute_from, but stops just 
+*       before the first input instruction, so the machine can be 
+*       snapshotted there.
+*
+*       In/Out Expectations: Same as execute_from, with pc pointing at the
+*       pc to start at. Returns true if it stopped at an input instruction,
+*       with *pc set to that instruction and the registers in r; returns 
+*       false if the program halted first.
 */
-void execute_program(memory mem, uint32_t *r)
+bool execute_until_input(memory mem, uint32_t *r, uint32_t *pc, 
+                         io_buffer io)
 {
-        uint32_t program_counter = 0;
+        return run_until_input(mem, r, pc, io, NULL, NULL, NULL, NULL, 
+                               NULL);
+}
+
+/*
+*       Description: Runs the program like execute_from, but only for as
+*       many instructions as a budget allows, or until it needs input that
+*       isn't there yet (see io_blocked), so the caller can get control 
+*       back and resume it later.
+*
+*       In/Out Expectations: Same as execute_from, with pc pointing at the
+*       pc to start at and budget at the most instructions to run (a fused
+*       pair counts as two, and is split if only one fits, so the budget 
+*       is kept exactly). Sets *budget to the part of the budget not used.
+*       Returns UM_HALTED on halt; otherwise UM_OUT_OF_BUDGET or 
+*       UM_BLOCKED, with *pc set to the next instruction and the registers
+*       in r (run it again to carry on).
+*/
+Um_status execute_budgeted(memory mem, uint32_t *r, uint32_t *pc, 
+                           io_buffer io, uint64_t *budget)
+{
+        if (!run_budgeted(mem, r, pc, io, NULL, NULL, budget, NULL, NULL)) {
+                return UM_HALTED;
+        }
+        /* the budget only stops the loop once it is all used */
+        return *budget == 0 ? UM_OUT_OF_BUDGET : UM_BLOCKED;
+}
+
+/*
+*       Description: Runs the program like execute_from, but checks each
+*       instruction for a um fault (see Um_fault_kind) before running it,
+*       and stops at the first one instead of running on into undefined 
+*       behavior. Slower than the fast loop; meant for tests and debugging.
+*
+*       In/Out Expectations: Same as execute_from, with pc pointing at the
+*       pc to start at, plus a fault to fill in. Returns UM_HALTED on halt
+*       (with the fault's kind UM_FAULT_NONE), or UM_FAULTED with the fault
+*       filled in, *pc set to the faulting instruction and the registers 
+*       in r. Output before the fault has been flushed.
+*/
+Um_status execute_checked(memory mem, uint32_t *r, uint32_t *pc,
+                          io_buffer io, Um_fault *fault)
+{
+        fault->kind = UM_FAULT_NONE;
+        if (!run_checked(mem, r, pc, io, NULL, NULL, NULL, fault, NULL)) {
+                return UM_HALTED;
+        }
+        return UM_FAULTED;
+}
+
+/*
+*       Description: Runs the program like execute_program, handing a 
+*       trace every instruction it runs: to write a trace of the run, or
+*       to replay one (see um_trace).
+*
+*       In/Out Expectations: Same as execute_program, plus a trace from 
+*       new_trace or open_trace. Returns true if the program halted, or 
+*       false if the trace stopped it (a write failed, or the replay 
+*       diverged from the log or came to its end).
+*/
+bool execute_traced(memory mem, uint32_t *r, io_buffer io, trace t)
+{
+        uint32_t pc = 0;
+        return !run_traced(mem, r, &pc, io, NULL, NULL, NULL, NULL, t);
+}
+
+/*
+*       Description: Prints a fault from execute_checked: the pc, the 
+*       instruction, what went wrong (with the operands involved), and the
+*       registers.
+*
+*       In/Out Expectations: Expects a fault whose kind isn't 
+*       UM_FAULT_NONE and the stream to print it on. Returns nothing.
+*/
+void report_fault(const Um_fault *fault, FILE *out)
+{
+        static const char *const names[] = {
+                "CMOV", "SLOAD", "SSTORE", "ADD", "MUL", "DIV", "NAND",
+                "HALT", "MAP", "UNMAP", "OUT", "IN", "LOADP", "LOADV",
+                "INVALID14", "INVALID15"
+        };
+        const uint32_t *r = fault->registers;
+        uint32_t code = get_code(fault->instruction);
+        uint32_t a = um_getu(fault->instruction, 3, 6);
+        uint32_t b = um_getu(fault->instruction, 3, 3);
+        uint32_t c = um_getu(fault->instruction, 3, 0);
+
+        if (fault->kind == UM_FAULT_BAD_PC) {
+                fprintf(out, "Error: um fault at pc %" PRIu32 ": the pc is "
+                        "past the end of segment 0.\n", fault->pc);
+        } else {
+                fprintf(out, "Error: um fault at pc %" PRIu32 " (%s, "
+                        "instruction 0x%08" PRIx32 "): ", fault->pc, 
+                        names[code], fault->instruction);
+        }
+
+        /* segment and index operands: SSTORE's are in a and b */
+        uint32_t seg = (code == SSTORE) ? r[a] : 
+                       (code == UNMAP) ? r[c] : r[b];
+        uint32_t index = (code == SSTORE) ? r[b] : r[c];
+        switch (fault->kind) {
+        case UM_FAULT_BAD_SEGMENT:
+                fprintf(out, "segment %" PRIu32 " isn't mapped.\n", seg);
+                break;
+        case UM_FAULT_OUT_OF_BOUNDS:
+                fprintf(out, "index %" PRIu32 " is past the end of segment "
+                        "%" PRIu32 ".\n", index, seg);
+                break;
+        case UM_FAULT_UNMAP_ZERO:
+                fprintf(out, "segment 0 can't be unmapped.\n");
+                break;
+        case UM_FAULT_DIVIDE_BY_ZERO:
+                fprintf(out, "division by zero (r%" PRIu32 " is 0).\n", c);
+                break;
+        case UM_FAULT_INVALID_OPCODE:
+                fprintf(out, "opcode %" PRIu32 " isn't an instruction.\n",
+                        code);
+                break;
+        case UM_FAULT_BAD_OUTPUT:
+                fprintf(out, "output value %" PRIu32 " is over 255.\n", 
+                        r[c]);
+                break;
+        default:
+                break;
+        }
+
+        for (int i = 0; i < 8; i++) {
+                fprintf(out, "%sr%d = 0x%08" PRIx32, (i % 4 == 0) ? 
+                        "        " : "  ", i, r[i]);
+                if (i % 4 == 3) {
+                        fprintf(out, "\n");
+                }
+        }
+}
+
+/*
+*       Description: Runs the program like execute_program, while 
+*       recording a profile of the run.
+*
+*       In/Out Expectations: Same as execute_program, plus a profile from
+*       new_profile, which holds the counts and timing of the run when this
+*       returns. Returns nothing.
+*/
+void execute_profiled(memory mem, uint32_t *r, io_buffer io, profile prof)
+{
+        profile_start(prof);
+        uint32_t pc = 0;
+        run_profiled(mem, r, &pc, io, prof, NULL, NULL, NULL, NULL);
+        profile_stop(prof);
+}
+
+/*
+*       Description: Runs the program like execute_program, with hot 
+*       straight-line code compiled to machine code by um_jit. Where the 
+*       jit isn't available this is execute_program.
+*
+*       In/Out Expectations: Same as execute_program. Returns nothing.
+*/
+void execute_jit(memory mem, uint32_t *r, io_buffer io)
+{
+        uint32_t pc = 0;
+        jit j = new_jit(mem, JIT_THRESHOLD, false);
+        if (j == NULL) {
+                run_fast(mem, r, &pc, io, NULL, NULL, NULL, NULL, NULL);
+                return;
+        }
+        run_jit(mem, r, &pc, io, NULL, j, NULL, NULL, NULL);
+        free_jit(j);
+}
+
+/*
+*       Description: Runs the program like execute_budgeted, running
+*       compiled blocks with a jit, so the jit can be run in step with the
+*       reference loop (see um_diff).
+*
+*       In/Out Expectations: Same as execute_budgeted, plus a counting jit
+*       from new_jit for mem (kept from one call to the next), or NULL
+*       where none is available, which runs execute_budgeted. Returns as
+*       execute_budgeted does.
+*/
+Um_status execute_jit_budgeted(memory mem, uint32_t *r, uint32_t *pc,
+                               io_buffer io, jit j, uint64_t *budget)
+{
+        if (j == NULL) {
+                return execute_budgeted(mem, r, pc, io, budget);
+        }
+        if (!run_jit_budgeted(mem, r, pc, io, NULL, j, budget, NULL,
+                              NULL)) {
+                return UM_HALTED;
+        }
+        return *budget == 0 ? UM_OUT_OF_BUDGET : UM_BLOCKED;
+}
+
+/*
+*       Description: The reference implementation of the instruction loop.
+*       Decodes every field of every instruction into an operation_info
+*       struct and calls the out-of-line handler for the opcode. It is
+*       slow, but simple enough to check the faster loop against.
+*
+*       In/Out Expectations: Same as execute_program. Returns nothing.
+*/
+void execute_reference(memory mem, uint32_t *r, io_buffer io)
+{
+        uint32_t pc = 0;
+        uint64_t budget = UINT64_MAX;
+        execute_reference_budgeted(mem, r, &pc, io, &budget);
+}
+
+/*
+*       Description: Runs the reference loop for at most a number of 
+*       instructions, so it can be run in step with the fast loop (see
+*       um_diff).
+*
+*       In/Out Expectations: Same as execute_budgeted, except that input
+*       is read as the io buffer gives it (it never blocks). Returns 
+*       UM_HALTED on halt, or UM_OUT_OF_BUDGET with *pc set to the next 
+*       instruction and *budget to 0.
+*/
+Um_status execute_reference_budgeted(memory mem, uint32_t *r, uint32_t *pc,
+                                     io_buffer io, uint64_t *budget)
+{
+        uint32_t program_counter = *pc;
         Um_opcode opcode; 
-        operation_info curr_info = malloc(sizeof(*curr_info));
-        curr_info->registers = r;
-        curr_info->mem = mem;
+        struct operation_info curr_info;
+        curr_info.registers = r;
+        curr_info.mem = mem;
+        curr_info.io = io;
 
         do {
+                if (*budget == 0) {
+                        *pc = program_counter;
+                        io_flush(io);
+                        return UM_OUT_OF_BUDGET;
+                }
+                (*budget)--;
                 uint32_t curr_instruction = 
                 get_memory(mem, 0, program_counter);
-                get_values(curr_instruction, curr_info);
+                get_values(curr_instruction, &curr_info);
                 opcode = get_code(curr_instruction);
                 switch(opcode){
                 case CMOV:
-                        conditional_move(curr_info);
+                        conditional_move(&curr_info);
                         break;
                 
                 case SLOAD:
-                        segmented_load(curr_info);
+                        segmented_load(&curr_info);
                         break;
 
                 case SSTORE:
-                        segmented_store(curr_info);
+                        segmented_store(&curr_info);
                         break;
 
                 case ADD:
-                        addition(curr_info);
+                        addition(&curr_info);
                         break;
 
                 case MUL:
-                        multiplication(curr_info);
+                        multiplication(&curr_info);
                         break;
 
                 case DIV:
-                        division(curr_info);
+                        division(&curr_info);
                         break;
 
                 case NAND:
-                        bitwise_nand(curr_info);
+                        bitwise_nand(&curr_info);
                         break;
 
                 case HALT:
                         break;
                 
                 case MAP:
-                        map(curr_info);
+                        map(&curr_info);
                         break;
 
                 case UNMAP:
-                        unmap(curr_info);
+                        unmap(&curr_info);
                         break;
 
                 case OUT:
-                        output(curr_info);
+                        output(&curr_info);
                         break;
 
                 case IN:
-                        input(curr_info);
+                        input(&curr_info);
                         break;
 
                 case LOADP:
-                        program_counter = load_program(curr_info); 
+                        program_counter = load_program(&curr_info); 
                         /* decrements so that first program instruction runs */
                         program_counter--;
                         break;
 
                 case LOADV:
-                        load_value(curr_info);
+                        load_value(&curr_info);
+                        break;
+
+                default:
+                        /* superinstructions exist only in decoded code */
                         break;
                 }
                 program_counter++;
-                check_values(curr_info);
         } while (opcode != HALT);
 
-        free(curr_info);
+        *pc = program_counter - 1;
+        io_flush(io);
+        return UM_HALTED;
 }
 
 /*
@@ -145,7 +511,7 @@ void execute_program(memory mem, uint32_t *r)
 */
 uint32_t get_code(Um_instruction instruction)
 {
-        return Bitpack_getu(instruction, 4, 28);
+        return um_getu(instruction, 4, 28);
 }
 
 /*
@@ -161,25 +527,11 @@ uint32_t get_code(Um_instruction instruction)
 */
 void get_values(Um_instruction instruction, operation_info info) 
 {
-        info->ra = Bitpack_getu(instruction, 3, 6);
-        info->rb = Bitpack_getu(instruction, 3, 3);
-        info->rc = Bitpack_getu(instruction, 3, 0);
-        info->ra_load = Bitpack_getu(instruction, 3, 25);
-        info->load_value = Bitpack_getu(instruction, 25, 0);
-}
-
-/*
-*       Description: Asserts that all register values are less than 7.
-*
-*       In/Out Expectations: Expects a operation_info struct. Returns nothing.
-*       Fails program if one register value is not less than 7.
-*/
-void check_values(operation_info info) 
-{
-        assert(info->ra <= 7);
-        assert(info->rb <= 7);
-        assert(info->rc <= 7);
-        assert(info->ra_load <= 7);
+        info->ra = um_getu(instruction, 3, 6);
+        info->rb = um_getu(instruction, 3, 3);
+        info->rc = um_getu(instruction, 3, 0);
+        info->ra_load = um_getu(instruction, 3, 25);
+        info->load_value = um_getu(instruction, 25, 0);
 }
 
 /*
@@ -334,7 +686,7 @@ void unmap(operation_info info)
 }
 
 /*
-*       Description: A function that prints to standard output the value
+*       Description: A function that prints to the output buffer the value
 *       in registers specified by register c. 
 *
 *       In/Out Expectations: Expects a populated operation_info struct 
@@ -346,12 +698,12 @@ void unmap(operation_info info)
 void output(operation_info info)
 {
         assert(info->registers[info->rc] <= MAX_VAL);
-        printf("%c", info->registers[info->rc]);
+        io_put(info->io, info->registers[info->rc]);
 }
 
 /*
-*       Description: A function that reads from a character from 
-8       standard input and places its corresponding int in register c.
+*       Description: A function that reads a character from the input
+*       buffer and places its corresponding int in register c.
 *       If the character from standard input is the EOF character,
 *       places a uint32_t of the bit sequence of all 1s in register c.
 *
@@ -364,14 +716,13 @@ void output(operation_info info)
 */
 void input(operation_info info)
 {
-        int input = getchar();
-        if(input == EOF) {
+        uint32_t input = io_get(info->io);
+        if(input == UM_IO_EOF) {
                 info->registers[info->rc] = ~0;
         }
         else {
                 assert(input <= MAX_VAL);
-                assert(input >= MIN_VAL);
-                info->registers[info->rc] = (uint32_t)input;
+                info->registers[info->rc] = input;
         }
 }
 
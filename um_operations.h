@@ -17,16 +17,75 @@
 
 #include <stdio.h>
 #include <stdbool.h>
-#include "assert.h"
-#include "seq.h"
+#include <assert.h>
 #include "memory_type.h"
-#include "bitpack.h"
+#include "um_io.h"
+#include "um_profile.h"
+#include "um_trace.h"
+#include "um_jit.h"
+
+/*
+ * Marks what libum.so exports: the um_machine API and report_fault. The
+ * library's objects are built with -fvisibility=hidden, so everything 
+ * else stays internal and can't clash with a host's own symbols.
+ */
+#if defined(__GNUC__)
+#define UM_API __attribute__((visibility("default")))
+#else
+#define UM_API
+#endif
 
 typedef struct operation_info *operation_info;
 
 typedef uint32_t Um_instruction;
 
-void execute_program(memory mem, uint32_t *r);
+/* Why execute_budgeted or execute_checked returned */
+typedef enum Um_status { 
+        UM_HALTED, UM_OUT_OF_BUDGET, UM_BLOCKED, UM_FAULTED
+} Um_status;
+
+/* The ways a um program can fail (which the fast loops don't check for) */
+typedef enum Um_fault_kind {
+        UM_FAULT_NONE,
+        UM_FAULT_BAD_SEGMENT,      /* load, store, unmap or load program
+                                      of a segment that isn't mapped */
+        UM_FAULT_OUT_OF_BOUNDS,    /* load or store past a segment's end */
+        UM_FAULT_BAD_PC,           /* pc past the end of segment 0 */
+        UM_FAULT_UNMAP_ZERO,       /* unmap of segment 0 */
+        UM_FAULT_DIVIDE_BY_ZERO,
+        UM_FAULT_INVALID_OPCODE,   /* opcode 14 or 15 */
+        UM_FAULT_BAD_OUTPUT        /* output of a value over 255 */
+} Um_fault_kind;
+
+/*
+ * A fault execute_checked stopped on: what it was, the pc of the faulting
+ * instruction and the instruction (0 for UM_FAULT_BAD_PC), and the 
+ * registers just before it would have run.
+ */
+typedef struct Um_fault {
+        Um_fault_kind kind;
+        uint32_t pc;
+        uint32_t instruction;
+        uint32_t registers[8];
+} Um_fault;
+
+void execute_program(memory mem, uint32_t *r, io_buffer io);
+void execute_from(memory mem, uint32_t *r, uint32_t pc, io_buffer io);
+bool execute_until_input(memory mem, uint32_t *r, uint32_t *pc, 
+                         io_buffer io);
+Um_status execute_budgeted(memory mem, uint32_t *r, uint32_t *pc, 
+                           io_buffer io, uint64_t *budget);
+Um_status execute_checked(memory mem, uint32_t *r, uint32_t *pc,
+                          io_buffer io, Um_fault *fault);
+UM_API void report_fault(const Um_fault *fault, FILE *out);
+bool execute_traced(memory mem, uint32_t *r, io_buffer io, trace t);
+void execute_profiled(memory mem, uint32_t *r, io_buffer io, profile prof);
+void execute_jit(memory mem, uint32_t *r, io_buffer io);
+Um_status execute_jit_budgeted(memory mem, uint32_t *r, uint32_t *pc,
+                               io_buffer io, jit j, uint64_t *budget);
+void execute_reference(memory mem, uint32_t *r, io_buffer io);
+Um_status execute_reference_budgeted(memory mem, uint32_t *r, uint32_t *pc,
+                                     io_buffer io, uint64_t *budget);
 uint32_t get_code(Um_instruction instruction);
 void get_values(Um_instruction instruction, operation_info info);
 void conditional_move(operation_info info);
@@ -42,6 +101,5 @@ void output(operation_info info);
 void input(operation_info info);
 uint32_t load_program(operation_info info);
 void load_value(operation_info info);
-void check_values(operation_info info);
 
 #endif 
\ No newline at end of file
@@ -0,0 +1,178 @@
+/******************************************************************************
+*       um_pool.c
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the implementation of the work-stealing thread
+*       pool. Each worker owns a range of indices, which it runs from the
+*       front; when its range is empty it takes the back half of another
+*       worker's range. Every range has its own lock, so workers only
+*       contend when one of them is stealing.
+*
+******************************************************************************/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <assert.h>
+#include "um_pool.h"
+
+#define MAX_THREADS 256
+
+struct pool;
+
+/*
+*       Description: One worker: the indices [next, end) it still has to
+*       run, the lock that guards them, and its place in the pool.
+*/
+struct worker {
+        pthread_mutex_t lock;
+        size_t next;
+        size_t end;
+        int id;
+        struct pool *pool;
+        pthread_t thread;
+};
+
+struct pool {
+        struct worker *workers;
+        int num_workers;
+        pool_task task;
+        void *cl;
+};
+
+/*
+*       Description: Gets the number of threads to use when the caller has
+*       no preference: one per online processor.
+*
+*       In/Out Expectations: Expects nothing. Returns a count between 1 and
+*       MAX_THREADS.
+*/
+int pool_default_threads(void)
+{
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (cpus < 1) {
+                return 1;
+        }
+        return cpus > MAX_THREADS ? MAX_THREADS : (int)cpus;
+}
+
+/*
+*       Description: Takes the next index from a worker's own range.
+*
+*       In/Out Expectations: Expects a worker and a place to store the
+*       index. Returns false if the range is empty.
+*/
+static bool take_own(struct worker *w, size_t *index)
+{
+        pthread_mutex_lock(&w->lock);
+        bool found = w->next < w->end;
+        if (found) {
+                *index = w->next++;
+        }
+        pthread_mutex_unlock(&w->lock);
+        return found;
+}
+
+/*
+*       Description: Moves the back half of another worker's range (at
+*       least one index) into a worker's own, empty range, trying the
+*       other workers in turn starting after this one.
+*
+*       In/Out Expectations: Expects a worker whose range is empty. Returns
+*       false if every other worker's range is empty too.
+*/
+static bool steal(struct worker *w)
+{
+        struct pool *pool = w->pool;
+        for (int i = 1; i < pool->num_workers; i++) {
+                struct worker *victim =
+                        &pool->workers[(w->id + i) % pool->num_workers];
+                pthread_mutex_lock(&victim->lock);
+                size_t left = victim->end - victim->next;
+                size_t begin = victim->end - (left + 1) / 2;
+                size_t end = victim->end;
+                victim->end = begin;
+                pthread_mutex_unlock(&victim->lock);
+
+                if (begin < end) {
+                        pthread_mutex_lock(&w->lock);
+                        w->next = begin;
+                        w->end = end;
+                        pthread_mutex_unlock(&w->lock);
+                        return true;
+                }
+        }
+        return false;
+}
+
+/*
+*       Description: A worker thread's body: runs its own indices, then
+*       steals until there is nothing left anywhere.
+*
+*       In/Out Expectations: Expects a pointer to the worker. Returns NULL.
+*/
+static void *work(void *arg)
+{
+        struct worker *w = arg;
+        size_t index;
+        do {
+                while (take_own(w, &index)) {
+                        w->pool->task(w->pool->cl, index);
+                }
+        } while (steal(w));
+        return NULL;
+}
+
+/*
+*       Description: Runs task(cl, index) once for every index from 0 to
+*       count - 1, on up to the given number of threads, and waits for all
+*       of them. The calling thread is one of the workers.
+*
+*       In/Out Expectations: Expects the number of indices, a thread count
+*       (anything below 1 means pool_default_threads), a task that is safe
+*       to call from several threads at once, and the closure to pass it.
+*       Indices run in no particular order. Returns nothing.
+*/
+void pool_run(size_t count, int threads, pool_task task, void *cl)
+{
+        if (threads < 1) {
+                threads = pool_default_threads();
+        }
+        if (threads > MAX_THREADS) {
+                threads = MAX_THREADS;
+        }
+        if ((size_t)threads > count) {
+                threads = (count == 0) ? 1 : (int)count;
+        }
+
+        struct pool pool = { NULL, threads, task, cl };
+        pool.workers = malloc(threads * sizeof(struct worker));
+        assert(pool.workers != NULL);
+        for (int i = 0; i < threads; i++) {
+                struct worker *w = &pool.workers[i];
+                pthread_mutex_init(&w->lock, NULL);
+                w->next = count * i / threads;
+                w->end = count * (i + 1) / threads;
+                w->id = i;
+                w->pool = &pool;
+        }
+
+        for (int i = 1; i < threads; i++) {
+                int failed = pthread_create(&pool.workers[i].thread, NULL,
+                                            work, &pool.workers[i]);
+                assert(!failed);
+        }
+        work(&pool.workers[0]);
+        for (int i = 1; i < threads; i++) {
+                pthread_join(pool.workers[i].thread, NULL);
+        }
+
+        for (int i = 0; i < threads; i++) {
+                pthread_mutex_destroy(&pool.workers[i].lock);
+        }
+        free(pool.workers);
+}
@@ -0,0 +1,25 @@
+/******************************************************************************
+*       um_pool.h
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the declarations for a small work-stealing thread
+*       pool. It runs a task once for each index in a range, splitting the
+*       range between the threads; a thread that runs out of indices steals
+*       half of what another thread has left.
+*
+******************************************************************************/
+
+#ifndef UM_POOL_
+#define UM_POOL_
+
+#include <stddef.h>
+
+typedef void (*pool_task)(void *cl, size_t index);
+
+int pool_default_threads(void);
+void pool_run(size_t count, int threads, pool_task task, void *cl);
+
+#endif
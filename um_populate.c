@@ -5,9 +5,13 @@
 *
 *       Comp40 Project 6: um
 *
-*       This file contains functions to read in characters from the user's 
-*       .um file and bitpack them into 32 bit words representing um
-*       instructions. The instructions are stored in the 0 segment in memory
+*       This file contains functions to read in the user's .um file and 
+*       convert its big-endian 32 bit words into um instructions. Regular 
+*       files are mapped into memory with mmap; anything else (such as a 
+*       pipe) is read in with bulk reads. The words are byte-swapped in one
+*       pass straight into the array that becomes the 0 segment in memory.
+*       A program already in memory (e.g. in a host embedding the um) can
+*       be loaded the same way with populate_bytes.
 *   
 ******************************************************************************/
 
@@ -15,53 +19,182 @@
 #include <stdbool.h>
 #include "um_populate.h"
 #include "memory_type.h"
-#include "bitpack.h"
 #include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+#define READ_CHUNK 65536
 
 typedef uint32_t Um_instruction;
 
+static void swap_words(uint32_t *dst, const uint32_t *src, size_t n);
+static uint32_t *map_words(int fd, size_t size);
+static uint32_t *read_words(int fd, size_t *size);
+
 /*
-*       Description: Calls function to create words from the characters 
-*       in a um file until the end of file has been reached.
+*       Description: Reads every instruction in a um file into a new 0 
+*       segment.
 *
 *       In/Out Expectations: Expects a valid input file and memory type 
-*       (linked from our module memory_type) from main. Returns void.
+*       (linked from our module memory_type) from main. Returns true once
+*       segment 0 holds the program, or false, leaving memory untouched, 
+*       if the file can't be read or its size isn't a multiple of 4 bytes.
 */
-void populate_instructions(FILE *input, memory mem)
+bool populate_instructions(FILE *input, memory mem)
 {
         assert(input != NULL);
+        int fd = fileno(input);
 
-        new_seg(mem, 0); 
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+                return false;
+        }
+
+        uint32_t *words;
+        size_t size;
+        if (S_ISREG(st.st_mode)) {
+                size = st.st_size;
+                if (size % sizeof(Um_instruction) != 0) {
+                        return false;
+                }
+                words = map_words(fd, size);
+        } else {
+                words = read_words(fd, &size);
+        }
+        if (words == NULL) {
+                return false;
+        }
 
-        bool is_eof;
-        do {
-                is_eof = make_word(input, mem);
-        } while (!is_eof);
+        adopt_seg(mem, words, size / sizeof(Um_instruction));
+        decode_program(mem);
+        return true;
 }
 
 /*
-*       Description: Populates words from the characters read in, and adds 
-*       them to the first segment in memory. 
+*       Description: Puts a program held in memory, as the big-endian words
+*       of a .um file, into a new 0 segment.
 *
-*       In/Out Expectations: Expects a valid input file and memory type 
-*       (linked from our module memory_type) from the populate 
-*       instruction function. Uses a linked module bitpack to create a word 
-*       from 4 characters read in. Returns true when the end of file is 
-*       reached, otherwise returns false. 
+*       In/Out Expectations: Expects the program's bytes and their number, 
+*       and a memory type like populate_instructions. Returns true once 
+*       segment 0 holds the program, or false, leaving memory untouched, 
+*       if length isn't a multiple of 4.
+*/
+bool populate_bytes(const unsigned char *bytes, size_t length, memory mem)
+{
+        if (length % sizeof(Um_instruction) != 0) {
+                return false;
+        }
+        size_t n = length / sizeof(Um_instruction);
+        uint32_t *words = malloc(n > 0 ? length : sizeof(Um_instruction));
+        assert(words != NULL);
+        if (n > 0) {
+                memcpy(words, bytes, length);
+                swap_words(words, words, n);
+        }
+
+        adopt_seg(mem, words, n);
+        decode_program(mem);
+        return true;
+}
+
+/*
+*       Description: Converts big-endian words into host order. Uses SSSE3 
+*       byte shuffles four words at a time when the compiler targets them,
+*       and a scalar loop otherwise (which compilers also vectorize at -O3).
+*
+*       In/Out Expectations: Expects a source of n big-endian words and a
+*       destination with room for n words; the two may be the same array.
+*       Returns nothing.
+*/
+static void swap_words(uint32_t *dst, const uint32_t *src, size_t n)
+{
+        size_t i = 0;
+#if defined(__SSSE3__)
+        const __m128i swap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11,
+                                          4, 5, 6, 7, 0, 1, 2, 3);
+        for (; i + 4 <= n; i += 4) {
+                __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+                _mm_storeu_si128((__m128i *)(dst + i),
+                                 _mm_shuffle_epi8(v, swap));
+        }
+#endif
+        for (; i < n; i++) {
+                dst[i] = __builtin_bswap32(src[i]);
+        }
+}
+
+/*
+*       Description: Loads a regular file by mapping it and byte-swapping 
+*       the mapping into a new array of words.
+*
+*       In/Out Expectations: Expects an open file descriptor for a regular
+*       file of size bytes, a multiple of 4. Returns a malloc'd array of 
+*       size / 4 words, or NULL if the file can't be mapped.
+*/
+static uint32_t *map_words(int fd, size_t size)
+{
+        size_t n = size / sizeof(Um_instruction);
+        uint32_t *words = malloc(n > 0 ? size : sizeof(Um_instruction));
+        assert(words != NULL);
+        if (n == 0) {
+                return words;
+        }
+
+        void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+                free(words);
+                return NULL;
+        }
+        madvise(map, size, MADV_SEQUENTIAL);
+        swap_words(words, map, n);
+        munmap(map, size);
+        return words;
+}
+
+/*
+*       Description: Loads a file that can't be mapped, such as a pipe, by
+*       reading it in large chunks and byte-swapping the words in place.
+*
+*       In/Out Expectations: Expects an open file descriptor. Sets *size to
+*       the number of bytes read. Returns a malloc'd array of *size / 4 
+*       words, or NULL if reading fails or *size isn't a multiple of 4.
 */
-bool make_word(FILE *input, memory mem)
+static uint32_t *read_words(int fd, size_t *size)
 {
-        int c;
-        Um_instruction word = 0;
-        for (int i = 24; i >= 0; i = i - 8) {
-                c = getc(input);
-                if (c == EOF) {
-                        return true;
+        size_t capacity = READ_CHUNK;
+        size_t length = 0;
+        char *bytes = malloc(capacity);
+        assert(bytes != NULL);
+
+        for (;;) {
+                if (length == capacity) {
+                        capacity *= 2;
+                        bytes = realloc(bytes, capacity);
+                        assert(bytes != NULL);
                 }
-                word = Bitpack_newu(word, 8, i, c);
+                ssize_t got = read(fd, bytes + length, capacity - length);
+                if (got == 0) {
+                        break;
+                }
+                if (got < 0) {
+                        free(bytes);
+                        return NULL;
+                }
+                length += got;
         }
-        set_memory(mem, 0, word);
-        return false;
-}
\ No newline at end of file
+
+        if (length % sizeof(Um_instruction) != 0) {
+                free(bytes);
+                return NULL;
+        }
+        uint32_t *words = (uint32_t *)bytes;
+        swap_words(words, words, length / sizeof(Um_instruction));
+        *size = length;
+        return words;
+}
@@ -5,10 +5,9 @@
 *
 *       Comp40 Project 6: um
 *
-*       This file contains the function declarations for functions needed to
-*       populate the zero segment with instructions, including looping through
-*       the file, extracting characters, packing them into a 32 bit word, and
-*       adding them to the zero segment. 
+*       This file contains the function declaration for the function needed
+*       to populate the zero segment with instructions, by loading the file 
+*       and converting its big-endian words into instructions. 
 *   
 ******************************************************************************/
 
@@ -19,9 +18,8 @@
 #include <stdbool.h>
 #include <inttypes.h>
 #include "memory_type.h"
-#include "bitpack.h"
 
-void populate_instructions(FILE *input, memory mem);
-bool make_word(FILE *input, memory mem);
+bool populate_instructions(FILE *input, memory mem);
+bool populate_bytes(const unsigned char *bytes, size_t length, memory mem);
 
 #endif 
\ No newline at end of file
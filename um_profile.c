@@ -0,0 +1,366 @@
+/******************************************************************************
+*       um_profile.c
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the implementation of the um's instruction 
+*       profiler, and the text and JSON reports it writes at halt.
+*   
+******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <assert.h>
+#include "um_profile.h"
+#include "um_decode.h"
+
+#define NUM_OPCODES 16
+#define HOT_PCS 20
+#define INITIAL_PCS 1024
+
+static const char *const opcode_names[NUM_OPCODES] = {
+        "CMOV", "SLOAD", "SSTORE", "ADD", "MUL", "DIV", "NAND", "HALT",
+        "MAP", "UNMAP", "OUT", "IN", "LOADP", "LOADV", "INVALID14", 
+        "INVALID15"
+};
+
+/*
+*       Description: Everything a profiling run records. pc_counts is 
+*       indexed by segment 0 program counter and grows to the largest one 
+*       executed; since load program replaces segment 0, a count covers
+*       every program that ran at that offset.
+*/
+struct profile {
+        uint64_t instructions;
+        uint64_t opcode_counts[NUM_OPCODES];
+        uint64_t *pc_counts;
+        uint32_t pcs_capacity;
+        uint64_t maps;
+        uint64_t unmaps;
+        uint64_t live_segments;
+        uint64_t live_high_water;
+        uint64_t loadps;
+        uint64_t loadps_replacing;
+        struct timespec start;
+        double seconds;
+};
+
+/*
+*       Description: Creates an empty profile.
+*
+*       In/Out Expectations: Expects nothing. Returns a profile with all 
+*       counts at zero and segment 0 counted as live, to be freed with 
+*       free_profile.
+*/
+profile new_profile(void)
+{
+        profile prof = calloc(1, sizeof(*prof));
+        assert(prof != NULL);
+        prof->pcs_capacity = INITIAL_PCS;
+        prof->pc_counts = calloc(prof->pcs_capacity, sizeof(uint64_t));
+        assert(prof->pc_counts != NULL);
+        prof->live_segments = 1;
+        prof->live_high_water = 1;
+        return prof;
+}
+
+/*
+*       Description: Frees a profile.
+*
+*       In/Out Expectations: Expects a profile from new_profile. Returns 
+*       nothing.
+*/
+void free_profile(profile prof)
+{
+        free(prof->pc_counts);
+        free(prof);
+}
+
+/*
+*       Description: Records the time a profiled run starts.
+*
+*       In/Out Expectations: Expects a valid profile. Returns nothing.
+*/
+void profile_start(profile prof)
+{
+        clock_gettime(CLOCK_MONOTONIC, &prof->start);
+}
+
+/*
+*       Description: Records how long the profiled run took since 
+*       profile_start.
+*
+*       In/Out Expectations: Expects a valid, started profile. Returns 
+*       nothing.
+*/
+void profile_stop(profile prof)
+{
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        prof->seconds = (end.tv_sec - prof->start.tv_sec) + 
+                        (end.tv_nsec - prof->start.tv_nsec) / 1e9;
+}
+
+/*
+*       Description: Counts one executed instruction, or both halves of a
+*       superinstruction.
+*
+*       In/Out Expectations: Expects a valid profile, the instruction's 
+*       opcode and the segment 0 program counter it was fetched from. 
+*       Returns nothing.
+*/
+void profile_step(profile prof, uint32_t opcode, uint32_t pc)
+{
+        if (opcode >= UM_FUSED_FIRST) {
+                uint32_t first, second;
+                fused_parts(opcode, &first, &second);
+                profile_step(prof, first, pc);
+                profile_step(prof, second, pc + 1);
+                return;
+        }
+        prof->instructions++;
+        prof->opcode_counts[opcode]++;
+        if (pc >= prof->pcs_capacity) {
+                uint32_t capacity = prof->pcs_capacity;
+                while (pc >= capacity) {
+                        capacity *= 2;
+                }
+                prof->pc_counts = realloc(prof->pc_counts, 
+                                          capacity * sizeof(uint64_t));
+                assert(prof->pc_counts != NULL);
+                memset(prof->pc_counts + prof->pcs_capacity, 0,
+                       (capacity - prof->pcs_capacity) * sizeof(uint64_t));
+                prof->pcs_capacity = capacity;
+        }
+        prof->pc_counts[pc]++;
+}
+
+/*
+*       Description: Counts a mapped segment and updates the high-water 
+*       mark of live segments.
+*
+*       In/Out Expectations: Expects a valid profile. Returns nothing.
+*/
+void profile_map(profile prof)
+{
+        prof->maps++;
+        if (++prof->live_segments > prof->live_high_water) {
+                prof->live_high_water = prof->live_segments;
+        }
+}
+
+/*
+*       Description: Counts an unmapped segment.
+*
+*       In/Out Expectations: Expects a valid profile. Returns nothing.
+*/
+void profile_unmap(profile prof)
+{
+        prof->unmaps++;
+        prof->live_segments--;
+}
+
+/*
+*       Description: Counts a load program, separately noting the ones 
+*       that replace segment 0 with another segment (rather than just 
+*       jumping).
+*
+*       In/Out Expectations: Expects a valid profile and the segment being
+*       loaded. Returns nothing.
+*/
+void profile_loadp(profile prof, uint32_t seg)
+{
+        prof->loadps++;
+        if (seg != 0) {
+                prof->loadps_replacing++;
+        }
+}
+
+/*
+*       Description: Finds the indices of the largest counts.
+*
+*       In/Out Expectations: Expects an array of counts, its length, and an
+*       array of HOT_PCS entries. Fills the latter with indices in 
+*       decreasing order of count, and returns how many counts were nonzero
+*       (at most HOT_PCS).
+*/
+static int hottest(const uint64_t *counts, uint32_t length, uint32_t *hot)
+{
+        int found = 0;
+        for (uint32_t i = 0; i < length; i++) {
+                uint64_t count = counts[i];
+                if (count == 0 || 
+                    (found == HOT_PCS && count <= counts[hot[found - 1]])) {
+                        continue;
+                }
+                int j = found < HOT_PCS ? found++ : HOT_PCS - 1;
+                while (j > 0 && counts[hot[j - 1]] < count) {
+                        hot[j] = hot[j - 1];
+                        j--;
+                }
+                hot[j] = i;
+        }
+        return found;
+}
+
+/*
+*       Description: Finds the most executed program counter values.
+*
+*       In/Out Expectations: Expects a valid profile and an array of 
+*       HOT_PCS entries. Fills it with program counters in decreasing order
+*       of count, and returns how many of them were executed at all.
+*/
+static int hottest_pcs(profile prof, uint32_t *hot)
+{
+        return hottest(prof->pc_counts, prof->pcs_capacity, hot);
+}
+
+/*
+*       Description: Computes the run's instruction rate.
+*
+*       In/Out Expectations: Expects a valid, stopped profile. Returns 
+*       instructions per second, or 0 if no time was recorded.
+*/
+static double per_second(profile prof)
+{
+        return prof->seconds > 0 ? prof->instructions / prof->seconds : 0;
+}
+
+/*
+*       Description: Writes a human-readable report of a stopped profile.
+*
+*       In/Out Expectations: Expects a valid profile and an open stream.
+*       Returns nothing.
+*/
+void profile_report(profile prof, FILE *out)
+{
+        fprintf(out, "== UM profile ==\n");
+        fprintf(out, "instructions      %" PRIu64 "\n", prof->instructions);
+        fprintf(out, "seconds           %.3f\n", prof->seconds);
+        fprintf(out, "instructions/sec  %.0f\n", per_second(prof));
+        fprintf(out, "-- opcodes --\n");
+        for (int op = 0; op < NUM_OPCODES; op++) {
+                if (prof->opcode_counts[op] == 0) {
+                        continue;
+                }
+                fprintf(out, "%-9s %14" PRIu64 "  %5.1f%%\n", 
+                        opcode_names[op], prof->opcode_counts[op],
+                        100.0 * prof->opcode_counts[op] / prof->instructions);
+        }
+        fprintf(out, "-- segments --\n");
+        fprintf(out, "maps %" PRIu64 ", unmaps %" PRIu64 
+                ", live high-water %" PRIu64 "\n",
+                prof->maps, prof->unmaps, prof->live_high_water);
+        fprintf(out, "loadp %" PRIu64 " (%" PRIu64 " from another segment)\n",
+                prof->loadps, prof->loadps_replacing);
+        fprintf(out, "-- hottest segment 0 pcs --\n");
+        uint32_t hot[HOT_PCS];
+        int found = hottest_pcs(prof, hot);
+        for (int i = 0; i < found; i++) {
+                fprintf(out, "%10" PRIu32 " %14" PRIu64 "\n", hot[i],
+                        prof->pc_counts[hot[i]]);
+        }
+}
+
+/*
+*       Description: Writes a stopped profile as one JSON object.
+*
+*       In/Out Expectations: Expects a valid profile and an open stream.
+*       Returns nothing.
+*/
+void profile_report_json(profile prof, FILE *out)
+{
+        fprintf(out, "{\"instructions\": %" PRIu64 ", \"seconds\": %.6f, "
+                "\"instructions_per_second\": %.0f,\n", 
+                prof->instructions, prof->seconds, per_second(prof));
+        fprintf(out, " \"opcodes\": {");
+        const char *sep = "";
+        for (int op = 0; op < NUM_OPCODES; op++) {
+                fprintf(out, "%s\"%s\": %" PRIu64, sep, opcode_names[op], 
+                        prof->opcode_counts[op]);
+                sep = ", ";
+        }
+        fprintf(out, "},\n \"maps\": %" PRIu64 ", \"unmaps\": %" PRIu64 
+                ", \"live_segments_high_water\": %" PRIu64 
+                ", \"loadps\": %" PRIu64 ", \"loadps_replacing\": %" PRIu64 
+                ",\n", prof->maps, prof->unmaps, prof->live_high_water,
+                prof->loadps, prof->loadps_replacing);
+        fprintf(out, " \"hot_pcs\": [");
+        uint32_t hot[HOT_PCS];
+        int found = hottest_pcs(prof, hot);
+        for (int i = 0; i < found; i++) {
+                fprintf(out, "%s{\"pc\": %" PRIu32 ", \"count\": %" PRIu64 
+                        "}", i > 0 ? ", " : "", hot[i], 
+                        prof->pc_counts[hot[i]]);
+        }
+        fprintf(out, "]}\n");
+}
+
+/*
+*       Description: Gives how often a segment 0 pc executed.
+*
+*       In/Out Expectations: Expects a valid profile and a pc. Returns the
+*       count, 0 if the pc never ran.
+*/
+static uint64_t pc_count(profile prof, uint32_t pc)
+{
+        return pc < prof->pcs_capacity ? prof->pc_counts[pc] : 0;
+}
+
+/*
+*       Description: Writes the run's hottest basic blocks and loops, from
+*       the program's cfg. A block's entries are the count of its first pc
+*       and its instructions the sum over its pcs; a loop's instructions 
+*       are the sum over its blocks. If a load program replaced segment 0
+*       the counts mix programs, so only that is reported.
+*
+*       In/Out Expectations: Expects a stopped profile, the cfg of the
+*       program it ran, and an open stream. Returns nothing.
+*/
+void profile_report_blocks(profile prof, cfg graph, FILE *out)
+{
+        if (prof->loadps_replacing > 0) {
+                fprintf(out, "-- basic blocks: not counted, segment 0 was "
+                        "replaced by load program --\n");
+                return;
+        }
+        uint32_t num_blocks = cfg_blocks(graph);
+        uint64_t *instructions = calloc(num_blocks + 1, sizeof(uint64_t));
+        uint64_t *loops = calloc(num_blocks + 1, sizeof(uint64_t));
+        assert(instructions != NULL && loops != NULL);
+        for (uint32_t i = 0; i < num_blocks; i++) {
+                const Cfg_block *block = cfg_block(graph, i);
+                for (uint32_t pc = block->start; pc < block->end; pc++) {
+                        instructions[i] += pc_count(prof, pc);
+                }
+                if (block->loop != CFG_NO_TARGET) {
+                        loops[block->loop] += instructions[i];
+                }
+        }
+
+        uint32_t hot[HOT_PCS];
+        int found = hottest(instructions, num_blocks, hot);
+        fprintf(out, "-- hottest basic blocks --\n");
+        for (int i = 0; i < found; i++) {
+                const Cfg_block *block = cfg_block(graph, hot[i]);
+                fprintf(out, "%10" PRIu32 "-%-10" PRIu32 " entries %14" 
+                        PRIu64 "  instructions %14" PRIu64 "  %5.1f%%\n",
+                        block->start, block->end - 1,
+                        pc_count(prof, block->start), instructions[hot[i]],
+                        100.0 * instructions[hot[i]] / prof->instructions);
+        }
+        found = hottest(loops, num_blocks, hot);
+        fprintf(out, "-- hottest loops --\n");
+        for (int i = 0; i < found; i++) {
+                const Cfg_block *block = cfg_block(graph, hot[i]);
+                fprintf(out, "loop at pc %-10" PRIu32 "  instructions %14"
+                        PRIu64 "  %5.1f%%\n", block->start, loops[hot[i]],
+                        100.0 * loops[hot[i]] / prof->instructions);
+        }
+        free(instructions);
+        free(loops);
+}
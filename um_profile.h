@@ -0,0 +1,39 @@
+/******************************************************************************
+*       um_profile.h
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the declarations for the um's instruction 
+*       profiler. A profile counts how often each opcode and each segment 0
+*       program counter value executes, tracks mapping, unmapping and load
+*       program activity, and times the run. It is only fed by the 
+*       profiling instruction loop, so the normal loop pays nothing for it.
+*       Given the program's cfg (um_cfg), it also reports the counts by
+*       basic block and loop.
+*   
+******************************************************************************/
+
+#ifndef UM_PROFILE_
+#define UM_PROFILE_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "um_cfg.h"
+
+typedef struct profile *profile;
+
+profile new_profile(void);
+void free_profile(profile prof);
+void profile_start(profile prof);
+void profile_stop(profile prof);
+void profile_step(profile prof, uint32_t opcode, uint32_t pc);
+void profile_map(profile prof);
+void profile_unmap(profile prof);
+void profile_loadp(profile prof, uint32_t seg);
+void profile_report(profile prof, FILE *out);
+void profile_report_json(profile prof, FILE *out);
+void profile_report_blocks(profile prof, cfg graph, FILE *out);
+
+#endif
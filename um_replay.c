@@ -0,0 +1,170 @@
+/******************************************************************************
+*       um_replay.c
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the replay tool for traces written by um --trace.
+*       It runs the traced program again, giving it the input recorded in
+*       the trace, and checks every instruction against the trace, so a
+*       run captured once (a slow codex session, say) can be checked and
+*       looked at offline. The program's output is dropped.
+*
+*       Usage: um_replay trace program.um
+*
+*       It prints how many instructions matched, or, at the first one that
+*       didn't, the instruction as the trace has it and as the replay ran
+*       it.
+*
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "memory_type.h"
+#include "um_populate.h"
+#include "um_operations.h"
+#include "um_io.h"
+#include "um_trace.h"
+
+/*
+*       Description: The recorded input, handed to the program as it asks.
+*/
+struct input {
+        const unsigned char *bytes;
+        size_t length;
+        size_t pos;
+};
+
+/*
+*       Description: An io_reader over the recorded input, and an io_writer
+*       that drops the output.
+*/
+static size_t read_input(void *cl, unsigned char *bytes, size_t max)
+{
+        struct input *input = cl;
+        size_t n = input->length - input->pos;
+        if (n > max) {
+                n = max;
+        }
+        if (n > 0) {
+                memcpy(bytes, input->bytes + input->pos, n);
+        }
+        input->pos += n;
+        return n;
+}
+
+static void drop_output(void *cl, const unsigned char *bytes, size_t length)
+{
+        (void)cl;
+        (void)bytes;
+        (void)length;
+}
+
+/*
+*       Description: Maps a whole file into memory.
+*
+*       In/Out Expectations: Expects a path and a place to store the
+*       length. Returns the bytes, to be unmapped with munmap, or NULL if
+*       the file can't be read or is empty.
+*/
+static const unsigned char *map_file(const char *path, size_t *length)
+{
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+                return NULL;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+                close(fd);
+                return NULL;
+        }
+        const unsigned char *bytes = mmap(NULL, info.st_size, PROT_READ,
+                                          MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (bytes == MAP_FAILED) {
+                return NULL;
+        }
+        madvise((void *)bytes, info.st_size, MADV_SEQUENTIAL);
+        *length = info.st_size;
+        return bytes;
+}
+
+/*
+*       Description: Loads the program the trace is replayed against.
+*
+*       In/Out Expectations: Expects the program's file name. Returns the
+*       memory, or NULL if the file can't be read or isn't a whole number
+*       of 32 bit words.
+*/
+static memory load_program_file(const char *filename)
+{
+        FILE *fp = fopen(filename, "r");
+        if (fp == NULL) {
+                return NULL;
+        }
+        memory mem = new_memory();
+        if (!populate_instructions(fp, mem)) {
+                free_memory(mem);
+                mem = NULL;
+        }
+        fclose(fp);
+        return mem;
+}
+
+/*
+*       Description: Replays a trace against a program and reports how it
+*       went.
+*
+*       In/Out Expectations: Expects the usage above. Returns exit failure
+*       if the trace or program can't be read, the trace was written from
+*       another program, or the replay diverged; otherwise exit success.
+*/
+int main(int argc, char *argv[])
+{
+        if (argc != 3) {
+                fprintf(stderr, "Usage: %s trace program.um\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+
+        size_t length;
+        const unsigned char *bytes = map_file(argv[1], &length);
+        trace t = (bytes == NULL) ? NULL : open_trace(bytes, length);
+        if (t == NULL) {
+                fprintf(stderr, "Error: %s isn't a readable um trace.\n",
+                        argv[1]);
+                return EXIT_FAILURE;
+        }
+        memory mem = load_program_file(argv[2]);
+        if (mem == NULL) {
+                fprintf(stderr, "Error: %s can't be read, or its size is "
+                        "not a multiple of 4 bytes.\n", argv[2]);
+                return EXIT_FAILURE;
+        }
+        if (!trace_matches(t, mem)) {
+                fprintf(stderr, "Error: %s wasn't traced from %s.\n",
+                        argv[1], argv[2]);
+                return EXIT_FAILURE;
+        }
+
+        struct input input = { NULL, 0, 0 };
+        unsigned char *recorded = trace_input(t, &input.length);
+        input.bytes = recorded;
+        io_buffer io = new_io_callbacks(read_input, drop_output, &input);
+        uint32_t registers[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        execute_traced(mem, registers, io, t);
+        bool ok = trace_report(t, stdout);
+
+        free_io(io);
+        free(recorded);
+        free_trace(t);
+        free_memory(mem);
+        munmap((void *)bytes, length);
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
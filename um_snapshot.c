@@ -0,0 +1,96 @@
+/******************************************************************************
+*       um_snapshot.c
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the implementation of um snapshots. A snapshot 
+*       file is a sequence of native 32 bit words: a magic number (which 
+*       also rejects files from a machine of the other byte order), a 
+*       format version, the program counter and the eight registers, then 
+*       the memory image from save_memory. Restoring maps the file and 
+*       rebuilds the memory straight from the mapping.
+*   
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "um_snapshot.h"
+
+#define SNAPSHOT_MAGIC 0x554d534e       /* "UMSN" */
+#define SNAPSHOT_VERSION 1
+#define HEADER_WORDS 11
+
+/*
+*       Description: Writes a snapshot of a um.
+*
+*       In/Out Expectations: Expects the path to write, a valid memory 
+*       type, the eight registers, and the pc to resume at. Returns false 
+*       if the file couldn't be written.
+*/
+bool save_snapshot(const char *path, memory mem, const uint32_t *r, 
+                   uint32_t pc)
+{
+        FILE *out = fopen(path, "wb");
+        if (out == NULL) {
+                return false;
+        }
+
+        uint32_t header[HEADER_WORDS] = { SNAPSHOT_MAGIC, SNAPSHOT_VERSION, 
+                                          pc };
+        for (int i = 0; i < 8; i++) {
+                header[3 + i] = r[i];
+        }
+        bool ok = fwrite(header, sizeof(uint32_t), HEADER_WORDS, out) == 
+                  HEADER_WORDS && save_memory(mem, out);
+        return fclose(out) == 0 && ok;
+}
+
+/*
+*       Description: Restores a um from a snapshot.
+*
+*       In/Out Expectations: Expects the path of a snapshot, room for the 
+*       eight registers, and a pc to set. Returns the restored memory, to 
+*       be freed with free_memory, or NULL if the file can't be read or 
+*       isn't a snapshot this um wrote.
+*/
+memory load_snapshot(const char *path, uint32_t *r, uint32_t *pc)
+{
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+                return NULL;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size % sizeof(uint32_t) != 0 ||
+            (size_t)info.st_size < HEADER_WORDS * sizeof(uint32_t)) {
+                close(fd);
+                return NULL;
+        }
+        const uint32_t *image = mmap(NULL, info.st_size, PROT_READ, 
+                                     MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (image == MAP_FAILED) {
+                return NULL;
+        }
+        madvise((void *)image, info.st_size, MADV_SEQUENTIAL);
+
+        memory mem = NULL;
+        if (image[0] == SNAPSHOT_MAGIC && image[1] == SNAPSHOT_VERSION) {
+                mem = restore_memory(image + HEADER_WORDS, 
+                                     info.st_size / sizeof(uint32_t) - 
+                                     HEADER_WORDS);
+        }
+        if (mem != NULL) {
+                *pc = image[2];
+                for (int i = 0; i < 8; i++) {
+                        r[i] = image[3 + i];
+                }
+        }
+        munmap((void *)image, info.st_size);
+        return mem;
+}
@@ -0,0 +1,25 @@
+/******************************************************************************
+*       um_snapshot.h
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the declarations for saving a whole um (its 
+*       registers, program counter and memory) to a snapshot file, and for
+*       restoring one, so a long boot can be paid for once.
+*   
+******************************************************************************/
+
+#ifndef UM_SNAPSHOT_
+#define UM_SNAPSHOT_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "memory_type.h"
+
+bool save_snapshot(const char *path, memory mem, const uint32_t *r, 
+                   uint32_t pc);
+memory load_snapshot(const char *path, uint32_t *r, uint32_t *pc);
+
+#endif
@@ -0,0 +1,581 @@
+/******************************************************************************
+*       um_trace.c
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the implementation of um execution traces. A
+*       trace file starts with the magic "UMTRACE" and a version byte, then
+*       the length of the traced program and a hash of its words, then one
+*       record per instruction:
+*
+*           a byte holding the opcode (bits 0-3), the register written
+*           (bits 4-6, 0 if none), and whether the pc isn't the one after
+*           the previous instruction's (bit 7);
+*           if bit 7 is set, the pc's distance from that one;
+*           the instruction's effect: for an instruction that writes a
+*           register, its new value (and for map the new segment's
+*           length); for a store, the segment, index and word; for unmap
+*           and load program, the segment; for output, the byte.
+*
+*       Numbers are unsigned LEB128 varints (7 bits a byte, low bits
+*       first), and signed ones (distances and changes) are zigzag-encoded
+*       first, so the common cases (straight-line code, small counters)
+*       take a byte or two. A register's new value is stored as its change
+*       or as itself, whichever is shorter (see register_change). A fused
+*       pair is recorded as its two instructions, so the log doesn't depend
+*       on how the um was built.
+*
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+#include "um_trace.h"
+#include "um_io.h"
+
+#define TRACE_MAGIC "UMTRACE"
+#define TRACE_VERSION 1
+#define MAGIC_BYTES 8
+#define BUFFER_BYTES 65536
+#define JUMP_BIT 0x80
+
+/* One instruction's record, with the fields it doesn't use 0 */
+struct event {
+        uint32_t pc;
+        uint32_t opcode;
+        uint32_t reg;
+        uint32_t value;
+        uint32_t seg;
+        uint32_t index;
+};
+
+/* Where a trace being replayed is */
+enum replay_state {
+        REPLAY_MATCHING, REPLAY_ENDED, REPLAY_CORRUPT, REPLAY_DIVERGED
+};
+
+/*
+*       Description: A trace being written (out and the buffer of bytes
+*       not yet written to it) or replayed (the bytes of the log and the
+*       position in them). Both sides keep the pc after the last
+*       instruction and the registers as the log has them, which the
+*       records are relative to.
+*/
+struct trace {
+        bool replaying;
+        FILE *out;
+        unsigned char *buffer;
+        size_t used;
+        bool failed;
+
+        const unsigned char *bytes;
+        size_t length;
+        size_t pos;
+        enum replay_state state;
+        struct event expected;
+        struct event got;
+
+        uint32_t program_length;
+        uint32_t program_hash;
+        uint32_t next_pc;
+        uint32_t registers[8];
+        uint64_t events;
+};
+
+/*
+*       Description: Checks whether an opcode's record has a register
+*       change.
+*/
+static bool writes_register(uint32_t opcode)
+{
+        return opcode == CMOV || opcode == SLOAD || opcode == ADD ||
+               opcode == MUL || opcode == DIV || opcode == NAND ||
+               opcode == MAP || opcode == IN || opcode == LOADV;
+}
+
+static uint32_t zigzag(uint32_t delta)
+{
+        return (delta << 1) ^ (uint32_t)-(int32_t)(delta >> 31);
+}
+
+static uint32_t unzigzag(uint32_t n)
+{
+        return (n >> 1) ^ (uint32_t)-(int32_t)(n & 1);
+}
+
+/*
+*       Description: Encodes a register's new value as the smaller of its
+*       change from the old value and the value itself (both zigzagged,
+*       so e.g. a counter's step and a small negative mask are each one 
+*       byte), with the low bit saying which; and decodes that.
+*/
+static uint64_t register_change(uint32_t old, uint32_t value)
+{
+        uint64_t delta = zigzag(value - old);
+        uint64_t plain = zigzag(value);
+        return (delta <= plain) ? delta << 1 : (plain << 1) | 1;
+}
+
+static uint32_t apply_change(uint32_t old, uint64_t n)
+{
+        uint32_t half = unzigzag(n >> 1);
+        return (n & 1) ? half : old + half;
+}
+
+/*
+*       Description: Hashes a program's words (FNV-1a), so a replay can
+*       tell that it is running the program that was traced.
+*
+*       In/Out Expectations: Expects a valid memory type. Returns the hash
+*       of segment 0.
+*/
+static uint32_t hash_program(memory mem)
+{
+        const uint32_t *words = get_segment(mem, 0);
+        uint32_t length = segment_length(mem, 0);
+        uint32_t hash = 2166136261u;
+        for (uint32_t i = 0; i < length; i++) {
+                for (int shift = 24; shift >= 0; shift -= 8) {
+                        hash = (hash ^ ((words[i] >> shift) & 0xff)) *
+                               16777619u;
+                }
+        }
+        return hash;
+}
+
+/*
+*       Description: Writes the buffered bytes of a trace to its file.
+*
+*       In/Out Expectations: Expects a trace being written. Returns false
+*       (from then on) if the file can't be written.
+*/
+static bool flush_trace(trace t)
+{
+        if (t->used > 0 && !t->failed &&
+            fwrite(t->buffer, 1, t->used, t->out) != t->used) {
+                t->failed = true;
+        }
+        t->used = 0;
+        return !t->failed;
+}
+
+static void put_byte(trace t, unsigned char byte)
+{
+        if (t->used == BUFFER_BYTES) {
+                flush_trace(t);
+        }
+        t->buffer[t->used++] = byte;
+}
+
+static void put_varint(trace t, uint64_t n)
+{
+        while (n >= 0x80) {
+                put_byte(t, (n & 0x7f) | 0x80);
+                n >>= 7;
+        }
+        put_byte(t, n);
+}
+
+/*
+*       Description: Reads a byte or a varint from a trace being replayed.
+*
+*       In/Out Expectations: Expects the trace and a place to store the
+*       number. Returns false if the log ends first (or the varint is too
+*       long for the number).
+*/
+static bool get_byte(trace t, uint32_t *byte)
+{
+        if (t->pos >= t->length) {
+                return false;
+        }
+        *byte = t->bytes[t->pos++];
+        return true;
+}
+
+static bool get_varint64(trace t, uint64_t *n)
+{
+        *n = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+                uint32_t byte;
+                if (!get_byte(t, &byte)) {
+                        return false;
+                }
+                *n |= (uint64_t)(byte & 0x7f) << shift;
+                if ((byte & 0x80) == 0) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+static bool get_varint(trace t, uint32_t *n)
+{
+        uint64_t wide;
+        if (!get_varint64(t, &wide) || wide > UINT32_MAX) {
+                return false;
+        }
+        *n = wide;
+        return true;
+}
+
+/*
+*       Description: Appends an instruction's record to a trace.
+*
+*       In/Out Expectations: Expects a trace being written and the event.
+*       Returns false if the file can't be written.
+*/
+static bool encode(trace t, const struct event *e)
+{
+        bool jump = e->pc != t->next_pc;
+        put_byte(t, e->opcode | (e->reg << 4) | (jump ? JUMP_BIT : 0));
+        if (jump) {
+                put_varint(t, zigzag(e->pc - t->next_pc));
+        }
+
+        if (writes_register(e->opcode)) {
+                put_varint(t, register_change(t->registers[e->reg],
+                                              e->value));
+                t->registers[e->reg] = e->value;
+                if (e->opcode == MAP) {
+                        put_varint(t, e->index);
+                }
+        } else if (e->opcode == SSTORE) {
+                put_varint(t, e->seg);
+                put_varint(t, e->index);
+                put_varint(t, e->value);
+        } else if (e->opcode == UNMAP || e->opcode == LOADP) {
+                put_varint(t, e->seg);
+        } else if (e->opcode == OUT) {
+                put_byte(t, e->value);
+        }
+        t->next_pc = e->pc + 1;
+        return !t->failed;
+}
+
+/*
+*       Description: Reads the next instruction's record from a trace.
+*
+*       In/Out Expectations: Expects a trace being replayed and an event to
+*       fill. Returns false if the log has ended (setting the state to
+*       REPLAY_ENDED) or the record is cut off or invalid (REPLAY_CORRUPT).
+*/
+static bool decode(trace t, struct event *e)
+{
+        uint32_t byte;
+        memset(e, 0, sizeof(*e));
+        if (!get_byte(t, &byte)) {
+                t->state = REPLAY_ENDED;
+                return false;
+        }
+        e->opcode = byte & 0xf;
+        e->reg = (byte >> 4) & 0x7;
+        e->pc = t->next_pc;
+
+        uint32_t n;
+        bool ok = (byte & JUMP_BIT) == 0 || get_varint(t, &n);
+        if (ok && (byte & JUMP_BIT)) {
+                e->pc += unzigzag(n);
+        }
+        if (!ok) {
+                /* a cut off distance; corrupt */
+        } else if (writes_register(e->opcode)) {
+                uint64_t change;
+                ok = get_varint64(t, &change);
+                e->value = apply_change(t->registers[e->reg], change);
+                t->registers[e->reg] = e->value;
+                if (ok && e->opcode == MAP) {
+                        ok = get_varint(t, &e->index);
+                }
+        } else if (e->opcode == SSTORE) {
+                ok = get_varint(t, &e->seg) && get_varint(t, &e->index) &&
+                     get_varint(t, &e->value);
+        } else if (e->opcode == UNMAP || e->opcode == LOADP) {
+                ok = get_varint(t, &e->seg);
+        } else if (e->opcode == OUT) {
+                ok = get_byte(t, &e->value);
+        } else {
+                ok = e->opcode == HALT;
+        }
+        if (!ok) {
+                t->state = REPLAY_CORRUPT;
+                return false;
+        }
+        t->next_pc = e->pc + 1;
+        return true;
+}
+
+/*
+*       Description: Handles one instruction from the tracing loop: writes
+*       its record, or, when replaying, checks it against the next record.
+*
+*       In/Out Expectations: Expects a trace and the instruction's event.
+*       Returns false, to stop the loop, if the trace can't be written or
+*       the replay has diverged from (or come to the end of) the log.
+*/
+static bool step(trace t, const struct event *e)
+{
+        if (!t->replaying) {
+                t->events++;
+                return encode(t, e);
+        }
+        if (t->state != REPLAY_MATCHING || !decode(t, &t->expected)) {
+                return false;
+        }
+        t->events++;
+        if (memcmp(&t->expected, e, sizeof(*e)) != 0) {
+                t->got = *e;
+                t->state = REPLAY_DIVERGED;
+                return false;
+        }
+        return true;
+}
+
+/*
+*       Description: Starts writing a trace of a program.
+*
+*       In/Out Expectations: Expects the open file to write to, which the
+*       caller closes after finish_trace, and the memory with the program
+*       about to run from pc 0 with all registers 0. Writes the header.
+*       Returns the trace, to be freed with free_trace.
+*/
+trace new_trace(FILE *out, memory mem)
+{
+        trace t = calloc(1, sizeof(*t));
+        assert(t != NULL);
+        t->out = out;
+        t->buffer = malloc(BUFFER_BYTES);
+        assert(t->buffer != NULL);
+        t->program_length = segment_length(mem, 0);
+        t->program_hash = hash_program(mem);
+
+        const char magic[MAGIC_BYTES] = TRACE_MAGIC;
+        for (int i = 0; i < MAGIC_BYTES - 1; i++) {
+                put_byte(t, magic[i]);
+        }
+        put_byte(t, TRACE_VERSION);
+        put_varint(t, t->program_length);
+        put_varint(t, t->program_hash);
+        return t;
+}
+
+/*
+*       Description: Opens a trace for replay.
+*
+*       In/Out Expectations: Expects the bytes of a trace file and their
+*       number, which must stay valid until the trace is freed. Returns the
+*       trace, to be freed with free_trace, or NULL if the bytes don't
+*       start with a trace header.
+*/
+trace open_trace(const unsigned char *bytes, size_t length)
+{
+        if (length < MAGIC_BYTES ||
+            memcmp(bytes, TRACE_MAGIC, MAGIC_BYTES - 1) != 0 ||
+            bytes[MAGIC_BYTES - 1] != TRACE_VERSION) {
+                return NULL;
+        }
+        trace t = calloc(1, sizeof(*t));
+        assert(t != NULL);
+        t->replaying = true;
+        t->bytes = bytes;
+        t->length = length;
+        t->pos = MAGIC_BYTES;
+        if (!get_varint(t, &t->program_length) ||
+            !get_varint(t, &t->program_hash)) {
+                free(t);
+                return NULL;
+        }
+        t->state = REPLAY_MATCHING;
+        return t;
+}
+
+/*
+*       Description: Checks that a replay is about to run the program the
+*       trace was written from.
+*
+*       In/Out Expectations: Expects a trace being replayed and the memory
+*       with the program loaded. Returns true if segment 0 has the traced
+*       program's length and hash.
+*/
+bool trace_matches(trace t, memory mem)
+{
+        return segment_length(mem, 0) == t->program_length &&
+               hash_program(mem) == t->program_hash;
+}
+
+/*
+*       Description: Gets the input the traced run read, so the replay can
+*       be given the same.
+*
+*       In/Out Expectations: Expects a trace being replayed that hasn't
+*       started, and a place to store the number of bytes. Returns the
+*       bytes read by input instructions, up to the first end of file, to
+*       be freed by the caller (NULL if there are none).
+*/
+unsigned char *trace_input(trace t, size_t *length)
+{
+        struct trace scan = *t;
+        unsigned char *input = NULL;
+        size_t capacity = 0;
+        struct event e;
+        *length = 0;
+        while (decode(&scan, &e)) {
+                if (e.opcode != IN) {
+                        continue;
+                }
+                if (e.value == UM_IO_EOF) {
+                        break;
+                }
+                if (*length == capacity) {
+                        capacity = capacity == 0 ? 4096 : 2 * capacity;
+                        input = realloc(input, capacity);
+                        assert(input != NULL);
+                }
+                input[(*length)++] = e.value;
+        }
+        return input;
+}
+
+/*
+*       Description: Writes out the rest of a trace being written.
+*
+*       In/Out Expectations: Expects a trace. Returns false if any of the
+*       trace couldn't be written (always true for a replay).
+*/
+bool finish_trace(trace t)
+{
+        return t->replaying || flush_trace(t);
+}
+
+/*
+*       Description: Frees a trace (but not its file or bytes).
+*
+*       In/Out Expectations: Expects a trace. Returns nothing.
+*/
+void free_trace(trace t)
+{
+        free(t->buffer);
+        free(t);
+}
+
+/*
+*       Description: Prints one event the way trace_report shows it.
+*/
+static void print_event(const struct event *e, FILE *out)
+{
+        static const char *const names[] = {
+                "CMOV", "SLOAD", "SSTORE", "ADD", "MUL", "DIV", "NAND",
+                "HALT", "MAP", "UNMAP", "OUT", "IN", "LOADP", "LOADV",
+                "INVALID14", "INVALID15"
+        };
+        fprintf(out, "pc %" PRIu32 ": %s", e->pc, names[e->opcode & 0xf]);
+        if (writes_register(e->opcode)) {
+                fprintf(out, " r%" PRIu32 " = 0x%08" PRIx32, e->reg,
+                        e->value);
+        }
+        if (e->opcode == MAP) {
+                fprintf(out, " (%" PRIu32 " words)", e->index);
+        } else if (e->opcode == SSTORE) {
+                fprintf(out, " [%" PRIu32 "][%" PRIu32 "] = 0x%08" PRIx32,
+                        e->seg, e->index, e->value);
+        } else if (e->opcode == UNMAP || e->opcode == LOADP) {
+                fprintf(out, " %" PRIu32, e->seg);
+        } else if (e->opcode == OUT) {
+                fprintf(out, " %" PRIu32, e->value);
+        }
+        fprintf(out, "\n");
+}
+
+/*
+*       Description: Says how a replay went: how many instructions matched,
+*       and the first that differed from the log (both versions of it) if
+*       any did.
+*
+*       In/Out Expectations: Expects a trace that has been replayed and the
+*       stream to print on. Returns true if every instruction matched
+*       (running out of log before the program halts is not a divergence,
+*       since a trace can be cut short).
+*/
+bool trace_report(trace t, FILE *out)
+{
+        switch (t->state) {
+        case REPLAY_DIVERGED:
+                fprintf(out, "The replay diverges from the trace at "
+                        "instruction %" PRIu64 ".\n  trace:  ", t->events);
+                print_event(&t->expected, out);
+                fprintf(out, "  replay: ");
+                print_event(&t->got, out);
+                return false;
+        case REPLAY_CORRUPT:
+                fprintf(out, "The trace is corrupt after instruction "
+                        "%" PRIu64 ".\n", t->events);
+                return false;
+        case REPLAY_ENDED:
+                fprintf(out, "%" PRIu64 " instructions replayed with no "
+                        "divergence; the trace ends before the program "
+                        "halts.\n", t->events);
+                return true;
+        default:
+                fprintf(out, "%" PRIu64 " instructions replayed with no "
+                        "divergence.\n", t->events);
+                return true;
+        }
+}
+
+/*
+*       Description: The hooks the tracing loop calls after each
+*       instruction: trace_reg for one that wrote a register (every
+*       conditional move counts, moved or not), and the others for the
+*       rest, with the segments and values involved.
+*
+*       In/Out Expectations: Expect a trace, the instruction's pc, and its
+*       operands and results. Return false if the loop should stop (see
+*       step).
+*/
+bool trace_reg(trace t, uint32_t pc, uint32_t opcode, uint32_t reg,
+               uint32_t value)
+{
+        struct event e = { pc, opcode, reg, value, 0, 0 };
+        return step(t, &e);
+}
+
+bool trace_store(trace t, uint32_t pc, uint32_t seg, uint32_t index,
+                 uint32_t value)
+{
+        struct event e = { pc, SSTORE, 0, value, seg, index };
+        return step(t, &e);
+}
+
+bool trace_map(trace t, uint32_t pc, uint32_t reg, uint32_t seg,
+               uint32_t length)
+{
+        struct event e = { pc, MAP, reg, seg, 0, length };
+        return step(t, &e);
+}
+
+bool trace_unmap(trace t, uint32_t pc, uint32_t seg)
+{
+        struct event e = { pc, UNMAP, 0, 0, seg, 0 };
+        return step(t, &e);
+}
+
+bool trace_out(trace t, uint32_t pc, uint32_t value)
+{
+        struct event e = { pc, OUT, 0, value, 0, 0 };
+        return step(t, &e);
+}
+
+bool trace_loadp(trace t, uint32_t pc, uint32_t seg)
+{
+        struct event e = { pc, LOADP, 0, 0, seg, 0 };
+        return step(t, &e);
+}
+
+bool trace_halt(trace t, uint32_t pc)
+{
+        struct event e = { pc, HALT, 0, 0, 0, 0 };
+        return step(t, &e);
+}
@@ -0,0 +1,49 @@
+/******************************************************************************
+*       um_trace.h
+*       By: Kalyn (kmuhle01) and Hannah (hshade01)
+*       4/1/2023
+*
+*       Comp40 Project 6: um
+*
+*       This file contains the declarations for um execution traces. A
+*       trace records every instruction a program runs (its pc and opcode,
+*       the register it wrote and the value, its effect on segments, and
+*       the bytes it read and wrote) in a compact binary log. The tracing
+*       instruction loop feeds a trace through the trace_ functions; a
+*       trace opened for replay takes the same calls, checks each against
+*       the next instruction in the log, and stops the loop at the first
+*       one that differs.
+*
+******************************************************************************/
+
+#ifndef UM_TRACE_
+#define UM_TRACE_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "memory_type.h"
+
+typedef struct trace *trace;
+
+trace new_trace(FILE *out, memory mem);
+trace open_trace(const unsigned char *bytes, size_t length);
+bool trace_matches(trace t, memory mem);
+unsigned char *trace_input(trace t, size_t *length);
+bool finish_trace(trace t);
+void free_trace(trace t);
+bool trace_report(trace t, FILE *out);
+
+bool trace_reg(trace t, uint32_t pc, uint32_t opcode, uint32_t reg,
+               uint32_t value);
+bool trace_store(trace t, uint32_t pc, uint32_t seg, uint32_t index,
+                 uint32_t value);
+bool trace_map(trace t, uint32_t pc, uint32_t reg, uint32_t seg,
+               uint32_t length);
+bool trace_unmap(trace t, uint32_t pc, uint32_t seg);
+bool trace_out(trace t, uint32_t pc, uint32_t value);
+bool trace_loadp(trace t, uint32_t pc, uint32_t seg);
+bool trace_halt(trace t, uint32_t pc);
+
+#endif